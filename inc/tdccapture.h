@@ -0,0 +1,149 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdccapture.h
+ *
+ *  Purpose:        Capture and replay of timestamp streams
+ *
+ */
+/*****************************************************************************/
+/** @file tdccapture.h
+ *  @brief Capture and replay of timestamp streams
+ *
+ *  The functions record the data an application retrieves from its
+ *  devices and replay them later without hardware, e.g. to reproduce
+ *  a data loss or a performance problem seen in the field.
+ *
+ *  Unlike @ref TDC_writeTimestamps, a capture keeps the structure of
+ *  the stream: every retrieved block of timestamps is stored with the
+ *  time it was retrieved and the device it came from, and data loss
+ *  states are stored between the blocks. A replay delivers the same
+ *  blocks in the same order, either with the original timing or as
+ *  fast as possible, so it is deterministic.
+ *
+ *  To capture, open a capture file with @ref TDC_startCapture and use
+ *  @ref TDC_captureLastTimestamps and @ref TDC_captureDataLost instead
+ *  of @ref TDC_getLastTimestamps and @ref TDC_getDataLost. Replayed
+ *  blocks are passed to the processing of the device library with
+ *  @ref TDC_inputTimestamps and/or to a callback that feeds them to the
+ *  analyses of this library.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCCAPTURE_H
+#define __TDCCAPTURE_H
+
+#include "tdcdecl.h"
+#include "tdcdevice.h"
+
+
+/** Replay Speed */
+typedef enum {
+  REPLAY_ORIGINAL,                   /**< Timing of the capture */
+  REPLAY_MAX                         /**< As fast as possible */
+} TDC_ReplaySpeed;
+
+
+/** Replay Callback
+ *
+ *  Type of a function that receives the replayed data.
+ *  @param devNo      Number of the device the data came from (see
+ *                    @ref TDC_openDevice), -1 for the global device
+ *  @param timestamps Timestamps of a block; NULL for a data loss record
+ *  @param channels   Channel numbers of a block; NULL for a data loss record
+ *  @param count      Number of events in the block
+ *  @param lost       Data loss state for a data loss record, else 0
+ *  @param user       Argument passed to @ref TDC_replayCapture
+ */
+typedef void (*TDC_ReplayFct)( Int32         devNo,
+                               const Int64 * timestamps,
+                               const Uint8 * channels,
+                               Int32         count,
+                               Bln32         lost,
+                               void        * user );
+
+
+/** Start Capture
+ *
+ *  Opens a capture file. All data retrieved by the capture functions
+ *  are recorded until @ref TDC_stopCapture is called.
+ *  A capture in progress is stopped. If the file exists, it is overwritten.
+ *  @param filename  Name of the file
+ *  @return Error code; @ref TDC_CantOpen if the file can't be opened,
+ *          @ref TDC_Error if the file of the capture in progress couldn't
+ *          be written completely; no new capture is started then.
+ */
+TDC_API int TDC_CC TDC_startCapture( const char * filename );
+
+
+/** Stop Capture
+ *
+ *  Closes the capture file.
+ *  @param blocks  Output: Number of blocks recorded; may be NULL.
+ *  @param events  Output: Number of events recorded; may be NULL.
+ *  @return Error code; @ref TDC_NotEnabled if no capture is in progress,
+ *          @ref TDC_Error if the file couldn't be written completely.
+ */
+TDC_API int TDC_CC TDC_stopCapture( Int64 * blocks,
+                                    Int64 * events );
+
+
+/** Retrieve and Capture Last Timestamp Values
+ *
+ *  Retrieves timestamps like @ref TDC_getLastTimestamps or
+ *  @ref TDC_devGetLastTimestamps and records them if a capture is in
+ *  progress. The arrays must not be NULL.
+ *  @param dev        Device handle; NULL for the device addressed
+ *                    with @ref TDC_addressDevice.
+ *  @param reset      If the data should be cleared after retrieving.
+ *  @param timestamps Output: Timestamps of the last events in ps.
+ *  @param channels   Output: Numbers of the channels.
+ *  @param valid      Output: Number of valid entries in the above arrays.
+ *  @return Error code
+ */
+TDC_API int TDC_CC TDC_captureLastTimestamps( TDC_Device * dev,
+                                              Bln32        reset,
+                                              Int64      * timestamps,
+                                              Uint8      * channels,
+                                              Int32      * valid );
+
+
+/** Retrieve and Capture Data Loss State
+ *
+ *  Retrieves the data loss state like @ref TDC_getDataLost or
+ *  @ref TDC_devGetDataLost and records it if a capture is in progress.
+ *  @param dev        Device handle; NULL for the device addressed
+ *                    with @ref TDC_addressDevice.
+ *  @param lost       Output: Current and latched data loss state.
+ *  @return Error code
+ */
+TDC_API int TDC_CC TDC_captureDataLost( TDC_Device * dev,
+                                        Bln32      * lost );
+
+
+/** Replay a Capture
+ *
+ *  Reads a capture file and delivers the recorded blocks in order.
+ *  The function returns when the file has been replayed completely.
+ *  @param filename  Name of the capture file
+ *  @param speed     Replay speed
+ *  @param input     Feed the blocks to the device library with
+ *                   @ref TDC_inputTimestamps
+ *  @param fct       Function that receives the blocks and data loss
+ *                   records; may be NULL.
+ *  @param user      Argument passed to fct
+ *  @param events    Output: Number of events replayed; may be NULL.
+ *  @return Error code; @ref TDC_CantOpen if the file can't be read,
+ *          @ref TDC_OutOfRange if it isn't a valid capture file.
+ *          Errors of @ref TDC_inputTimestamps stop the replay.
+ */
+TDC_API int TDC_CC TDC_replayCapture( const char      * filename,
+                                      TDC_ReplaySpeed   speed,
+                                      Bln32             input,
+                                      TDC_ReplayFct     fct,
+                                      void            * user,
+                                      Int64           * events );
+
+#endif
@@ -0,0 +1,304 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdccoinc.h
+ *
+ *  Purpose:        Coincidence counters for arbitrary channel groups
+ *
+ */
+/*****************************************************************************/
+/** @file tdccoinc.h
+ *  @brief Coincidence counters for arbitrary channel groups
+ *
+ *  The header provides a software counterpart of the built-in coincidence
+ *  counters (@ref TDC_getCoincCounters) that is not limited to the first
+ *  5 channels. Coincidences are counted for user defined groups of
+ *  any of the 32 channels and any multiplicity.
+ *
+ *  A delay can be set for every channel (@ref TDC_setCoincGroupDelay);
+ *  it is added to the timestamps of the channel. The delayed streams of
+ *  the channels are merged in time order; events are held back until
+ *  no earlier event can arrive anymore, i.e. the delays add latency.
+ *
+ *  Coincidences are detected with a sliding window: the latest event of
+ *  every channel is kept, and every event is tested against the groups
+ *  containing its channel. A group is counted once if the latest events
+ *  of all its other channels lie within the window of the group before
+ *  the event. Every group may have its own window
+ *  (@ref TDC_setCoincGroupWindow). Channels that belong to no group only
+ *  contribute to the singles.
+ *
+ *  The counters are integrated over exposures like the built-in ones
+ *  (see @ref TDC_setExposureTime); the exposures are taken from the
+ *  timestamps, exposure n covers the times n * expTime ...
+ *  (n+1) * expTime. A coincidence is counted in the exposure of the
+ *  event that completes it. An exposure is complete when the first
+ *  event of a later exposure is processed.
+ *
+ *  The complete exposures are also kept in a ring buffer of configurable
+ *  size (@ref TDC_setCoincGroupHistory). @ref TDC_drainCoincGroupCounters
+ *  retrieves all exposures that haven't been read before, so a client
+ *  that polls irregularly doesn't lose counts.
+ *
+ *  Accidental coincidences are estimated per group in two ways: by
+ *  counting on a copy of the event stream where the channels are shifted
+ *  against each other far beyond the coincidence window
+ *  (@ref TDC_setCoincGroupAccidentals), and analytically from the singles.
+ *  Both are evaluated for the exposure of @ref TDC_getCoincGroupCounters
+ *  and retrieved with @ref TDC_getCoincGroupAccidentals.
+ *
+ *  All times are given in the unit of the timestamps, i.e. ps, if
+ *  not stated otherwise.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCCOINC_H
+#define __TDCCOINC_H
+
+#include "tdcdecl.h"
+
+#define TDC_COINC_GROUPS  256   /**< Max. number of coincidence groups */
+
+
+/** Enable Coincidence Counting
+ *
+ *  Enables the coincidence counting. When disabled, the timestamps are
+ *  ignored. The function implicitly clears the counters.
+ *  @param enable  Enable or disable
+ *  @return        Error code
+ */
+TDC_API int TDC_CC TDC_enableCoincGroups( Bln32 enable );
+
+
+/** Set Coincidence Parameters
+ *
+ *  Sets the default coincidence window of the groups and the exposure time.
+ *  If the function is not called, default values are in place.
+ *  When the function is called, all collected data are cleared.
+ *  @param coincWin  Coincidence window [ps], Range = 0 ... 2,000,000,000,
+ *                   default = 1000
+ *  @param expTime   Exposure time [ms], Range = 1 ... 65535, default = 1000
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setCoincGroupParams( Int32 coincWin,
+                                            Int32 expTime );
+
+
+/** Get Coincidence Parameters
+ *
+ *  Retrieves the parameters set by @ref TDC_setCoincGroupParams.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param coincWin  Output: Coincidence window [ps]
+ *  @param expTime   Output: Exposure time [ms]
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getCoincGroupParams( Int32 * coincWin,
+                                            Int32 * expTime );
+
+
+/** Add a Coincidence Group
+ *
+ *  Adds a group of channels whose coincidences are to be counted.
+ *  When the function is called, all collected data are cleared.
+ *  @param chMask   Bitfield of the channels of the group
+ *                  (e.g. 5 means channels 1 and 3), at least one bit set.
+ *  @param group    Output: Index of the group, counting from 0; may be NULL.
+ *  @return         Error code; TDC_OutOfRange also if there are already
+ *                  @ref TDC_COINC_GROUPS groups.
+ */
+TDC_API int TDC_CC TDC_addCoincGroup( Int32   chMask,
+                                      Int32 * group );
+
+
+/** Set Coincidence Window of a Group
+ *
+ *  Sets an individual coincidence window for a group. An event completes
+ *  a coincidence of the group if the latest events of the other channels
+ *  of the group lie within the window before it, regardless of the
+ *  windows of other groups.
+ *  When the function is called, all collected data are cleared.
+ *  @param group    Index of the group
+ *  @param coincWin Coincidence window [ps], Range = 0 ... 2,000,000,000;
+ *                  -1 to use the window of @ref TDC_setCoincGroupParams
+ *                  (default).
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_setCoincGroupWindow( Int32 group,
+                                            Int32 coincWin );
+
+
+/** Get Coincidence Window of a Group
+ *
+ *  Retrieves the effective coincidence window of a group.
+ *  @param group    Index of the group
+ *  @param coincWin Output: Coincidence window [ps]
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getCoincGroupWindow( Int32   group,
+                                            Int32 * coincWin );
+
+
+/** Set Channel Delay
+ *
+ *  Sets a delay that is added to the timestamps of a channel before
+ *  coincidence counting. Other than @ref TDC_setChannelDelay, the
+ *  delay is applied in software and not limited to the hardware range.
+ *  When the function is called, all collected data are cleared.
+ *  @param channel  Channel number, Range = 1 ... 32
+ *  @param delay    Delay [ps], Range = -1,000,000,000 ... 1,000,000,000,
+ *                  default = 0
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_setCoincGroupDelay( Int32 channel,
+                                           Int32 delay );
+
+
+/** Get Channel Delay
+ *
+ *  Retrieves the parameter set by @ref TDC_setCoincGroupDelay.
+ *  @param channel  Channel number, Range = 1 ... 32
+ *  @param delay    Output: Delay [ps]
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getCoincGroupDelay( Int32   channel,
+                                           Int32 * delay );
+
+
+/** Remove all Coincidence Groups
+ *
+ *  Removes all groups. The singles counters remain active.
+ *  When the function is called, all collected data are cleared.
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_clearCoincGroups( void );
+
+
+/** Reset Coincidence Counters
+ *
+ *  Clears the counters and restarts with the next exposure.
+ *  @return  Error code
+ */
+TDC_API int TDC_CC TDC_resetCoincGroups( void );
+
+
+/** Process Timestamps
+ *
+ *  Feeds timestamps to the coincidence counting. The arrays have the format
+ *  delivered by @ref TDC_getLastTimestamps: timestamps in ps in increasing
+ *  order, channel numbers 0...31 for channels 1...32.
+ *  @param timestamps Input: Array of timestamps
+ *  @param channels   Input: Array of corresponding channel numbers
+ *  @param count      Number of valid elements in both arrays
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_addCoincGroupTimestamps( const Int64 * timestamps,
+                                                const Uint8 * channels,
+                                                Int32         count );
+
+
+/** Retrieve Coincidence Counters
+ *
+ *  Retrieves the counter values of the last complete exposure.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param singles   Output: Events per channel, array of 32 elements
+ *  @param coinc     Output: Coincidences per group in the order of
+ *                   @ref TDC_addCoincGroup
+ *  @param coincSize Input: Number of elements of coinc
+ *                   Output: Number of groups
+ *  @param updates   Output: Number of exposures completed since the
+ *                   last call, including exposures without events.
+ *  @return          Error code; TDC_OutOfRange if coinc is too small.
+ */
+TDC_API int TDC_CC TDC_getCoincGroupCounters( Int32 * singles,
+                                              Int32 * coinc,
+                                              Int32 * coincSize,
+                                              Int32 * updates );
+
+
+/** Set History Size
+ *
+ *  Sets the number of complete exposures kept for
+ *  @ref TDC_drainCoincGroupCounters.
+ *  When the function is called, all collected data are cleared.
+ *  @param size     Number of exposures, Range = 1 ... 65536, default = 64
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_setCoincGroupHistory( Int32 size );
+
+
+/** Get History Size
+ *
+ *  Retrieves the parameter set by @ref TDC_setCoincGroupHistory.
+ *  @param size     Output: Number of exposures
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getCoincGroupHistory( Int32 * size );
+
+
+/** Drain Coincidence Counter History
+ *
+ *  Retrieves the complete exposures that haven't been drained before,
+ *  oldest first, and marks them as read. If there are more unread
+ *  exposures than fit into the arrays, the remaining ones are kept for
+ *  the next call. Exposures without events are included.
+ *  All output parameters except count may be NULL to ignore the value.
+ *  @param times     Output: Start times of the exposures [ps],
+ *                   array of count elements
+ *  @param singles   Output: Events per channel, 32 elements per exposure
+ *  @param coinc     Output: Coincidences per group, one element per group
+ *                   and exposure
+ *  @param count     Input: Number of exposures that fit into the arrays
+ *                   Output: Number of exposures retrieved
+ *  @param lost      Output: Number of exposures with events that have been
+ *                   overwritten unread since the last call
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_drainCoincGroupCounters( Int64 * times,
+                                                Int32 * singles,
+                                                Int32 * coinc,
+                                                Int32 * count,
+                                                Int32 * lost );
+
+
+/** Set Accidentals Delay
+ *
+ *  Enables the counting of accidental coincidences with delayed windows:
+ *  the events of channel k are additionally delayed by k * delay and
+ *  counted like the original ones. The delay must be large compared to
+ *  the coincidence windows and the correlation times of the source and
+ *  should not be a multiple of a laser period.
+ *  When the function is called, all collected data are cleared.
+ *  @param delay    Delay [ps], Range = 0 ... 31,250,000; 0 disables the
+ *                  delayed window counting (default).
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_setCoincGroupAccidentals( Int32 delay );
+
+
+/** Retrieve Accidental Coincidences
+ *
+ *  Retrieves the accidental coincidence estimates for the exposure
+ *  of @ref TDC_getCoincGroupCounters, one element per group.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param delayed   Output: Accidentals counted with delayed windows;
+ *                   0 if disabled.
+ *  @param analytic  Output: Accidentals calculated from the singles as
+ *                   n * w^(n-1) * R1 * ... * Rn * expTime for a group of
+ *                   n channels with rates Ri and window w. This holds
+ *                   for Ri * w << 1; above, only the latest events
+ *                   of the channels are taken and fewer are counted.
+ *  @param corrected Output: Coincidences minus accidentals; the delayed
+ *                   window counts are used if enabled, else the
+ *                   analytic values.
+ *  @param coincSize Input: Number of elements of the arrays
+ *                   Output: Number of groups
+ *  @return          Error code; TDC_OutOfRange if the arrays are too small.
+ */
+TDC_API int TDC_CC TDC_getCoincGroupAccidentals( Int32  * delayed,
+                                                 double * analytic,
+                                                 double * corrected,
+                                                 Int32  * coincSize );
+
+#endif
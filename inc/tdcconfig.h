@@ -0,0 +1,142 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcconfig.h
+ *
+ *  Purpose:        Device configuration profiles
+ *
+ */
+/*****************************************************************************/
+/** @file tdcconfig.h
+ *  @brief Device configuration profiles
+ *
+ *  A @ref TDC_DeviceConfig holds the complete configuration of a device
+ *  as set by the functions of tdcbase.h: enabled channels and markers,
+ *  signal conditioning, delays, filters and the device parameters.
+ *  It can be read from a device, saved to and loaded from a text file,
+ *  and applied to a device.
+ *
+ *  Applying a configuration only sends the parameters that differ from
+ *  the current state of the device, and all of them while the device is
+ *  addressed once (see @ref tdcdevice.h). Switching between measurement
+ *  modes that differ in a few parameters therefore needs only a few
+ *  transfers.
+ *
+ *  The configuration of a device is cached in its handle. It is read
+ *  on first use and invalidated by the setting functions of
+ *  @ref tdcdevice.h and by @ref TDC_callDevice. @ref TDC_devGetConfig and
+ *  @ref TDC_devGetDeviceParams use the cache, so polling the
+ *  configuration doesn't communicate with the device. Changes made with
+ *  the functions of tdcbase.h directly are not detected; use
+ *  @ref TDC_devReadConfig to refresh the cache after them.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCCONFIG_H
+#define __TDCCONFIG_H
+
+#include "tdcdecl.h"
+#include "tdcbase.h"
+#include "tdcdevice.h"
+
+#define TDC_CONFIG_CHANNELS  (TDC_QUTAG_CHANNELS + 1)  /**< Channels incl. start */
+#define TDC_CONFIG_FILTERS   5                         /**< Channels with filters */
+
+
+/** Device Configuration
+ *
+ *  Channel related arrays are indexed by the channel number of
+ *  tdcbase.h, 0 = start input. Filters are indexed by channel - 1.
+ */
+typedef struct {
+  Int32          channels;        /**< Number of channels incl. start; read only */
+  Bln32          enStart;         /**< Start input enabled, see @ref TDC_enableChannels */
+  Int32          channelMask;     /**< Enabled stop channels */
+  Int32          markerMask;      /**< Enabled markers, see @ref TDC_enableMarkers */
+  Int32          coincWin;        /**< Coincidence window [ps] */
+  Int32          expTime;         /**< Exposure time [ms] */
+  Int32          bufferSize;      /**< Timestamp buffer size */
+  Int32          syncDivider;     /**< Start input divider; 0 if not available */
+  Bln32          syncReconstruct; /**< Reconstruct divided start events */
+  Bln32          edge[TDC_CONFIG_CHANNELS];       /**< Rising (1) or falling (0) edge */
+  double         threshold[TDC_CONFIG_CHANNELS];  /**< Threshold [V] */
+  Int32          delay[TDC_CONFIG_CHANNELS];      /**< Channel delay [ps] */
+  TDC_FilterType filterType[TDC_CONFIG_FILTERS];  /**< Filter type;
+                                                       FILTER_INVALID if not available */
+  Int32          filterMask[TDC_CONFIG_FILTERS];  /**< Filter channel mask */
+} TDC_DeviceConfig;
+
+
+/** Read a Device Configuration
+ *
+ *  Reads the complete configuration back from a device and updates the
+ *  cache. The signal conditioning is represented by edge and threshold,
+ *  as applied with @ref SCOND_MISC.
+ *  @param  dev      Device handle
+ *  @param  config   Output: Configuration
+ *  @return Error code
+ */
+TDC_API int TDC_CC TDC_devReadConfig( TDC_Device       * dev,
+                                      TDC_DeviceConfig * config );
+
+
+/** Get the Cached Device Configuration
+ *
+ *  Retrieves the cached configuration of a device. If the cache is
+ *  invalid, the configuration is read like @ref TDC_devReadConfig.
+ *  After @ref TDC_devApplyConfig, the thresholds are cached as applied;
+ *  the effective ones may differ by the resolution of the device.
+ *  @param  dev      Device handle
+ *  @param  config   Output: Configuration
+ *  @return Error code
+ */
+TDC_API int TDC_CC TDC_devGetConfig( TDC_Device       * dev,
+                                     TDC_DeviceConfig * config );
+
+
+/** Apply a Device Configuration
+ *
+ *  Configures a device as described by a configuration. Only the
+ *  parameters that differ from the cached device state are sent.
+ *  Channels the device doesn't have, unavailable filters and a sync
+ *  divider of 0 are ignored.
+ *  @param  dev      Device handle
+ *  @param  config   Configuration to apply
+ *  @param  sent     Output: Number of parameter settings sent; may be NULL.
+ *  @return Error code; on error, the parameters before the failing one
+ *          have been applied.
+ */
+TDC_API int TDC_CC TDC_devApplyConfig( TDC_Device             * dev,
+                                       const TDC_DeviceConfig * config,
+                                       Int32                  * sent );
+
+
+/** Save a Device Configuration
+ *
+ *  Writes a configuration to a text file with one parameter per line.
+ *  @param  filename Name of the file
+ *  @param  config   Configuration to save
+ *  @return Error code; @ref TDC_CantOpen if the file can't be written.
+ */
+TDC_API int TDC_CC TDC_saveConfig( const char             * filename,
+                                   const TDC_DeviceConfig * config );
+
+
+/** Load a Device Configuration
+ *
+ *  Reads a configuration written by @ref TDC_saveConfig. Parameters
+ *  missing in the file are left unchanged, so a profile may hold only
+ *  some parameters that are loaded on top of a configuration read from
+ *  the device.
+ *  @param  filename Name of the file
+ *  @param  config   Input: Configuration to update
+ *                   Output: Configuration with the parameters of the file
+ *  @return Error code; @ref TDC_CantOpen if the file can't be read,
+ *          @ref TDC_OutOfRange for an invalid line.
+ */
+TDC_API int TDC_CC TDC_loadConfig( const char       * filename,
+                                   TDC_DeviceConfig * config );
+
+#endif
@@ -0,0 +1,173 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdccorrmatrix.h
+ *
+ *  Purpose:        Correlation functions for arbitrary channel pairs
+ *
+ */
+/*****************************************************************************/
+/** @file tdccorrmatrix.h
+ *  @brief Correlation functions for arbitrary channel pairs
+ *
+ *  The header provides a software correlator that accumulates the
+ *  2nd order correlation functions of any number of channel pairs in a
+ *  single pass over the timestamp stream. Every channel keeps one sorted
+ *  window of its recent events that is shared by all pairs the channel
+ *  participates in; an incoming event is only compared with the windows
+ *  of its partner channels.
+ *
+ *  Set parameters with @ref TDC_setCorrMatrixParams, select channel pairs
+ *  with @ref TDC_addCorrPair and enable the correlator with
+ *  @ref TDC_enableCorrMatrix. Feed timestamps with
+ *  @ref TDC_addCorrMatrixTimestamps and retrieve results with
+ *  @ref TDC_getCorrMatrixFunction. Results are delivered in the
+ *  @ref TDC_HbtFunction format of the g(2) function.
+ *
+ *  All times are given in the unit of the timestamps, i.e. ps.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCCORRMATRIX_H
+#define __TDCCORRMATRIX_H
+
+#include "tdcdecl.h"
+#include "tdchbt.h"
+
+
+/** Enable Correlation Matrix
+ *
+ *  Enables the calculation of the correlation functions of all selected
+ *  channel pairs. When disabled, the timestamps are ignored and the
+ *  accumulated data are released.
+ *  The function implicitly clears the correlation functions.
+ *  @param enable  Enable or disable
+ *  @return        Error code
+ */
+TDC_API int TDC_CC TDC_enableCorrMatrix( Bln32 enable );
+
+
+/** Set Correlation Function Parameters
+ *
+ *  Sets the common parameters of all correlation functions.
+ *  If the function is not called, default values are in place.
+ *  When the function is called, all collected data are cleared.
+ *  @param binWidth  Width of a bin [ps], Range = 1 ... 1M, default = 100.
+ *  @param binCount  Number of bins of each direction.
+ *                   Range = 16 ... 64k, default = 256.
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setCorrMatrixParams( Int32 binWidth,
+                                            Int32 binCount );
+
+
+/** Get Correlation Function Parameters
+ *
+ *  Retrieves the parameters set by @ref TDC_setCorrMatrixParams.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param binWidth  Output: Width of a bin [ps]
+ *  @param binCount  Output: Number of bins of each direction
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getCorrMatrixParams( Int32 * binWidth,
+                                            Int32 * binCount );
+
+
+/** Add a Channel Pair
+ *
+ *  Adds or removes a correlation function for a pair of channels.
+ *  The pairs (a,b) and (b,a) are equivalent; a pair of equal channels
+ *  selects the autocorrelation. Nothing will happen if an already
+ *  existing pair is added and vice versa.
+ *  The function implicitly clears all correlation functions.
+ *  @param channel1  First  channel number, Range = 1...32
+ *  @param channel2  Second channel number, Range = 1...32
+ *  @param add       Add (true) or remove (false) the pair
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_addCorrPair( Int32 channel1,
+                                    Int32 channel2,
+                                    Bln32 add );
+
+
+/** Reset Correlation Functions
+ *
+ *  Clears all accumulated correlation functions and event counters.
+ *  @return  Error code
+ */
+TDC_API int TDC_CC TDC_resetCorrMatrix( void );
+
+
+/** Process Timestamps
+ *
+ *  Feeds timestamps to the correlator. The arrays have the format
+ *  delivered by @ref TDC_getLastTimestamps: timestamps in ps in increasing
+ *  order, channel numbers 0...31 for channels 1...32.
+ *  @param timestamps Input: Array of timestamps
+ *  @param channels   Input: Array of corresponding channel numbers
+ *  @param count      Number of valid elements in both arrays
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_addCorrMatrixTimestamps( const Int64 * timestamps,
+                                                const Uint8 * channels,
+                                                Int32         count );
+
+
+/** Retrieve Event Count and Integration Time
+ *
+ *  Retrieves the number of events of a channel since the last reset
+ *  and the time span covered by all events.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param channel  Channel number, Range = 1...32
+ *  @param count    Output: Number of events on the channel
+ *  @param intTime  Output: Integration time [ps], 0 if no events
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getCorrMatrixEventCount( Int32   channel,
+                                                Int64 * count,
+                                                Int64 * intTime );
+
+
+/** Retrieve Correlation Function
+ *
+ *  Retrieves the correlation function of a channel pair added with
+ *  @ref TDC_addCorrPair. The function covers time differences
+ *  t(channel2) - t(channel1) in 2*binCount-1 bins; the field indexOffset
+ *  marks the position of the argument 0, binWidth is given in ps.
+ *  @param channel1  First  channel number of the pair
+ *  @param channel2  Second channel number of the pair
+ *  @param normalize Deliver raw pair counts (false) or the normalized
+ *                   g(2) function (true), where 1 corresponds to
+ *                   uncorrelated events.
+ *  @param fct       Output: Function description. If the capacity
+ *                   of the buffer is not sufficient, TDC_OutOfRange
+ *                   will be returned.
+ *  @return          Error code; TDC_NotEnabled if the pair hasn't been added.
+ */
+TDC_API int TDC_CC TDC_getCorrMatrixFunction( Int32             channel1,
+                                              Int32             channel2,
+                                              Bln32             normalize,
+                                              TDC_HbtFunction * fct );
+
+
+/** Create Function Description
+ *
+ *  Creates a function description buffer by allocating memory
+ *  according to the current parameters (see @ref TDC_setCorrMatrixParams).
+ *  Release a buffer with @ref TDC_releaseCorrMatrixFunction.
+ *  @return  Address of a newly created buffer; NULL on error
+ */
+TDC_API TDC_HbtFunction * TDC_CC TDC_createCorrMatrixFunction( void );
+
+
+/** Release Function Description
+ *
+ *  Releases the memory allocated by @ref TDC_createCorrMatrixFunction.
+ *  @param fct      Function description to free.
+ *                  After the call, the pointer is invalid!
+ */
+TDC_API void TDC_CC TDC_releaseCorrMatrixFunction( TDC_HbtFunction * fct );
+
+#endif
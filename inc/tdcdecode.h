@@ -0,0 +1,110 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcdecode.h
+ *
+ *  Purpose:        Fast decoding of binary timestamp records
+ *
+ */
+/*****************************************************************************/
+/** @file tdcdecode.h
+ *  @brief Fast decoding of binary timestamp records
+ *
+ *  The functions decode the records of the binary timestamp formats
+ *  (see @ref TDC_writeTimestamps) into separate arrays of timestamps and
+ *  channel numbers, the format of @ref TDC_getLastTimestamps, so files
+ *  can be fed to the analyses without going through the device library.
+ *
+ *  There are vectorized implementations for CPUs with AVX2 and AVX-512
+ *  and a portable one. The best implementation available on the CPU is
+ *  selected at runtime; another one can be chosen with
+ *  @ref TDC_setDecodeImpl, e.g. for comparison.
+ *
+ *  The functions decode records only; the header of
+ *  @ref TDC_FILE_HEADER bytes at the beginning of a file must be skipped.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCDECODE_H
+#define __TDCDECODE_H
+
+#include "tdcdecl.h"
+
+#define TDC_FILE_HEADER        40   /**< Size of the file header [bytes] */
+#define TDC_BINARY_RECORD      10   /**< Size of a binary record [bytes] */
+#define TDC_COMPRESSED_RECORD   5   /**< Size of a compressed record [bytes] */
+
+
+/** Decoder Implementation */
+typedef enum {
+  DECODE_AUTO,                       /**< Best available implementation */
+  DECODE_SCALAR,                     /**< Portable implementation */
+  DECODE_AVX2,                       /**< Vectorized with AVX2 */
+  DECODE_AVX512                      /**< Vectorized with AVX-512 (F and BW) */
+} TDC_DecodeImpl;
+
+
+/** Select Decoder Implementation
+ *
+ *  Selects the implementation used by the decoding functions.
+ *  If the function is not called, @ref DECODE_AUTO is in place.
+ *  @param impl     Implementation
+ *  @return         Error code; @ref TDC_NotAvailable if the CPU or the build
+ *                  doesn't support the implementation.
+ */
+TDC_API int TDC_CC TDC_setDecodeImpl( TDC_DecodeImpl impl );
+
+
+/** Get Decoder Implementation
+ *
+ *  Retrieves the implementation in use; @ref DECODE_AUTO is resolved
+ *  to the one actually selected.
+ *  @param impl     Output: Implementation
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getDecodeImpl( TDC_DecodeImpl * impl );
+
+
+/** Decode Binary Records
+ *
+ *  Decodes records of the binary format: 8 bytes timestamp and 2 bytes
+ *  channel number, little endian.
+ *  @param records    Input: Records, count * @ref TDC_BINARY_RECORD bytes
+ *  @param count      Number of records
+ *  @param timestamps Output: Array of count timestamps [ps]
+ *  @param channels   Output: Array of count channel numbers
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_decodeBinary( const Uint8 * records,
+                                     Int32         count,
+                                     Int64       * timestamps,
+                                     Uint8       * channels );
+
+
+/** Decode Compressed Records
+ *
+ *  Decodes records of the compressed format: 40 bit little endian
+ *  words with the timestamp in the lower 37 bits and the channel
+ *  number in the upper 3 bits. The timestamps overflow every 2^37
+ *  units; an overflow is detected as a timestamp smaller than its
+ *  predecessor, and the number of overflows is added in the upper bits,
+ *  so the decoded timestamps increase monotonically. To decode a file in
+ *  several chunks, pass the last timestamp from one call to the next.
+ *  @param records    Input: Records, count * @ref TDC_COMPRESSED_RECORD bytes
+ *  @param count      Number of records
+ *  @param timestamps Output: Array of count timestamps
+ *  @param channels   Output: Array of count channel numbers
+ *  @param last       Input: Last timestamp of the previous chunk,
+ *                    0 at the beginning of a file;
+ *                    Output: Last timestamp decoded
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_decodeCompressed( const Uint8 * records,
+                                         Int32         count,
+                                         Int64       * timestamps,
+                                         Uint8       * channels,
+                                         Int64       * last );
+
+#endif
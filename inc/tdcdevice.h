@@ -0,0 +1,330 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcdevice.h
+ *
+ *  Purpose:        Handle based access to multiple devices
+ *
+ */
+/*****************************************************************************/
+/** @file tdcdevice.h
+ *  @brief Handle based access to multiple devices
+ *
+ *  The functions of @ref tdcmultidev.h select the target device of all
+ *  following calls with @ref TDC_addressDevice. That global state makes
+ *  it unsafe to control several devices from several threads.
+ *
+ *  The functions of this header take a device handle instead. They
+ *  address the device and call the corresponding function of tdcbase.h
+ *  as one atomic step. Every handle has its own lock, so calls to
+ *  the same device are serialized while the global address is only
+ *  locked for the duration of the call itself. Functions without a
+ *  dedicated wrapper can be called with @ref TDC_callDevice.
+ *
+ *  Use @ref TDC_discover to find the devices, then open handles with
+ *  @ref TDC_openDevice. Don't use @ref TDC_addressDevice concurrently
+ *  with the handle functions.
+ *
+ *  @ref TDC_startupDevices discovers and opens all devices in the
+ *  background, with one thread per device that also configures and
+ *  calibrates it. The calibrations of the devices run concurrently;
+ *  the progress is available per device with @ref TDC_getStartupState.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCDEVICE_H
+#define __TDCDEVICE_H
+
+#include "tdcdecl.h"
+#include "tdcbase.h"
+
+/** Device Handle
+ *
+ *  Opaque handle of a connected device, see @ref TDC_openDevice.
+ */
+typedef struct TDC_Device TDC_Device;
+
+/** Device Function
+ *
+ *  Callback for @ref TDC_callDevice.
+ *  @param  user     User data passed to @ref TDC_callDevice
+ *  @return Error code
+ */
+typedef int (TDC_CC * TDC_DeviceFct)( void * user );
+
+/** Startup Configuration Function
+ *
+ *  Callback for @ref TDC_startupDevices to configure a device.
+ *  It is called from the startup thread of the device and may use the
+ *  functions of this header with the handle.
+ *  @param  dev      Device handle
+ *  @param  user     User data passed to @ref TDC_startupDevices
+ *  @return Error code
+ */
+typedef int (TDC_CC * TDC_StartupFct)( TDC_Device * dev, void * user );
+
+/** Startup State of a Device
+ *
+ *  Progress of a device during @ref TDC_startupDevices.
+ */
+typedef enum {
+  STARTUP_PENDING,                    /**< Not started yet */
+  STARTUP_CONNECTING,                 /**< Opening the device */
+  STARTUP_CONFIGURING,                /**< Configuration function running */
+  STARTUP_CALIBRATING,                /**< Calibration running */
+  STARTUP_READY,                      /**< Device ready to use */
+  STARTUP_FAILED                      /**< Startup failed */
+} TDC_StartupState;
+
+
+/** Open a Device
+ *
+ *  Connects to a device found by @ref TDC_discover (if not connected
+ *  yet) and creates a handle for it.
+ *  @param  devNo     Number of the device, 0 &le; devNo < devCount.
+ *  @param  dev       Output: Device handle
+ *  @return Error code; @ref TDC_DeviceLocked if a handle for the device
+ *          is already open.
+ */
+TDC_API int TDC_CC TDC_openDevice( unsigned int  devNo,
+                                   TDC_Device ** dev );
+
+
+/** Close a Device
+ *
+ *  Disconnects the device and releases the handle. The handle must not
+ *  be in use by other threads.
+ *  @param  dev       Device handle
+ *  @return Error code
+ */
+TDC_API int TDC_CC TDC_closeDevice( TDC_Device * dev );
+
+
+/** Device Number
+ *
+ *  Retrieves the number of the device as used by @ref tdcmultidev.h.
+ *  @param  dev       Device handle
+ *  @param  devNo     Output: Number of the device
+ *  @return Error code
+ */
+TDC_API int TDC_CC TDC_getDeviceNo( TDC_Device   * dev,
+                                    unsigned int * devNo );
+
+
+/** Call a Function for a Device
+ *
+ *  Addresses the device and calls a function that may use any function
+ *  of tdcbase.h without device parameter; they will apply to the device.
+ *  The function must not call other functions of this header.
+ *  @param  dev       Device handle
+ *  @param  fct       Function to call
+ *  @param  user      User data passed to the function
+ *  @return Error code of addressing or the return value of the function
+ */
+TDC_API int TDC_CC TDC_callDevice( TDC_Device  * dev,
+                                   TDC_DeviceFct fct,
+                                   void        * user );
+
+
+/** Enable TDC Channels
+ *
+ *  @ref TDC_enableChannels for a device.
+ */
+TDC_API int TDC_CC TDC_devEnableChannels( TDC_Device * dev,
+                                          Bln32        enStart,
+                                          Int32        channelMask );
+
+
+/** Configure Signal Conditioning
+ *
+ *  @ref TDC_configureSignalConditioning for a device.
+ */
+TDC_API int TDC_CC TDC_devConfigureSignalConditioning( TDC_Device   * dev,
+                                                       Int32          channel,
+                                                       TDC_SignalCond conditioning,
+                                                       Bln32          edge,
+                                                       double         threshold );
+
+
+/** Set Channel Delay Time
+ *
+ *  @ref TDC_setChannelDelay for a device.
+ */
+TDC_API int TDC_CC TDC_devSetChannelDelay( TDC_Device * dev,
+                                           Int32        channel,
+                                           Int32        delay );
+
+
+/** Configure Output Filter
+ *
+ *  @ref TDC_configureFilter for a device.
+ */
+TDC_API int TDC_CC TDC_devConfigureFilter( TDC_Device   * dev,
+                                           Int32          channel,
+                                           TDC_FilterType type,
+                                           Int32          chMask );
+
+
+/** Set Coincidence Window
+ *
+ *  @ref TDC_setCoincidenceWindow for a device.
+ */
+TDC_API int TDC_CC TDC_devSetCoincidenceWindow( TDC_Device * dev,
+                                                Int32        coincWin );
+
+
+/** Set Exposure Time
+ *
+ *  @ref TDC_setExposureTime for a device.
+ */
+TDC_API int TDC_CC TDC_devSetExposureTime( TDC_Device * dev,
+                                           Int32        expTime );
+
+
+/** Read Back Device Parameters
+ *
+ *  @ref TDC_getDeviceParams for a device. The values are taken from the
+ *  configuration cache if it is valid, see @ref tdcconfig.h.
+ */
+TDC_API int TDC_CC TDC_devGetDeviceParams( TDC_Device * dev,
+                                           Int32      * coincWin,
+                                           Int32      * expTime );
+
+
+/** Set Timestamp Buffer Size
+ *
+ *  @ref TDC_setTimestampBufferSize for a device.
+ */
+TDC_API int TDC_CC TDC_devSetTimestampBufferSize( TDC_Device * dev,
+                                                  Int32        size );
+
+
+/** Retrieve Last Timestamp Values
+ *
+ *  @ref TDC_getLastTimestamps for a device.
+ */
+TDC_API int TDC_CC TDC_devGetLastTimestamps( TDC_Device * dev,
+                                             Bln32        reset,
+                                             Int64      * timestamps,
+                                             Uint8      * channels,
+                                             Int32      * valid );
+
+
+/** Retrieve Coincidence Counters
+ *
+ *  @ref TDC_getCoincCounters for a device.
+ */
+TDC_API int TDC_CC TDC_devGetCoincCounters( TDC_Device * dev,
+                                            Int32      * data,
+                                            Int32      * updates );
+
+
+/** Check for Data Loss
+ *
+ *  @ref TDC_getDataLost for a device.
+ */
+TDC_API int TDC_CC TDC_devGetDataLost( TDC_Device * dev,
+                                       Bln32      * lost );
+
+
+/** Internal Calibration
+ *
+ *  @ref TDC_startCalibration for a device.
+ */
+TDC_API int TDC_CC TDC_devStartCalibration( TDC_Device * dev );
+
+
+/** Inquire Calibration State
+ *
+ *  @ref TDC_getCalibrationState for a device.
+ */
+TDC_API int TDC_CC TDC_devGetCalibrationState( TDC_Device * dev,
+                                               Bln32      * active );
+
+
+/** Inquire Clock Sync State
+ *
+ *  @ref TDC_getClockState for a device.
+ */
+TDC_API int TDC_CC TDC_devGetClockState( TDC_Device * dev,
+                                         Bln32      * locked,
+                                         Bln32      * uplink );
+
+
+/** Configure external clock
+ *
+ *  @ref TDC_enableExternalClock for a device.
+ */
+TDC_API int TDC_CC TDC_devEnableExternalClock( TDC_Device * dev,
+                                               Bln32        enable );
+
+
+/** Start up all Devices
+ *
+ *  Discovers the devices and starts a background thread for every
+ *  device that opens it (see @ref TDC_openDevice), calls the
+ *  configuration function and optionally calibrates the device.
+ *  The function returns after the discovery.
+ *  Devices that are still open, e.g. from a previous startup, keep
+ *  their handles. If the startup of a device fails, a handle opened by
+ *  it is closed again.
+ *  @param  calibrate Start the calibration after the configuration and
+ *                    wait until it is complete
+ *  @param  configure Configuration function; may be NULL
+ *  @param  user      User data passed to the configuration function
+ *  @param  devCount  Output: Number of devices found; may be NULL.
+ *  @return Error code; @ref TDC_DeviceLocked if a startup is still running.
+ */
+TDC_API int TDC_CC TDC_startupDevices( Bln32          calibrate,
+                                       TDC_StartupFct configure,
+                                       void         * user,
+                                       unsigned int * devCount );
+
+
+/** Startup Progress
+ *
+ *  Retrieves the progress of a device after @ref TDC_startupDevices.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param  devNo     Number of the device
+ *  @param  state     Output: Startup state
+ *  @param  error     Output: Error code if the startup failed
+ *  @param  dev       Output: Device handle if the device is ready, else NULL;
+ *                    NULL also after the handle has been closed.
+ *  @return Error code
+ */
+TDC_API int TDC_CC TDC_getStartupState( unsigned int       devNo,
+                                        TDC_StartupState * state,
+                                        int              * error,
+                                        TDC_Device      ** dev );
+
+
+/** Startup Timing
+ *
+ *  Retrieves the durations of the startup phases of a device after
+ *  @ref TDC_startupDevices; phases not reached yet or skipped are 0.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param  devNo     Number of the device
+ *  @param  discover  Output: Duration of the discovery of all devices [ms]
+ *  @param  connect   Output: Duration of opening the device [ms]
+ *  @param  configure Output: Duration of the configuration function [ms]
+ *  @param  calibrate Output: Duration of the calibration [ms]
+ *  @return Error code
+ */
+TDC_API int TDC_CC TDC_getStartupTiming( unsigned int devNo,
+                                         Int32      * discover,
+                                         Int32      * connect,
+                                         Int32      * configure,
+                                         Int32      * calibrate );
+
+
+/** Wait for Startup
+ *
+ *  Waits until the startup of all devices is complete.
+ *  @param  timeout   Max. waiting time [ms]
+ *  @return Error code; @ref TDC_Timeout if the startup is not complete.
+ */
+TDC_API int TDC_CC TDC_waitStartup( Int32 timeout );
+
+#endif
@@ -0,0 +1,199 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcfit.h
+ *
+ *  Purpose:        Batch fitting of g(2) functions and lifetime histograms
+ *
+ */
+/*****************************************************************************/
+/** @file tdcfit.h
+ *  @brief Batch fitting of g(2) functions and lifetime histograms
+ *
+ *  The header provides functions to fit many g(2) functions
+ *  (@ref TDC_HbtFunction) or lifetime histograms (@ref TDC_LftFunction)
+ *  in one call. The fits are distributed over a pool of worker threads
+ *  and may start from the results of previous fits ("warm start").
+ *  The model functions are the same as those of @ref TDC_fitHbtG2 and
+ *  @ref TDC_fitLftHistogram, see @ref HBT_FctType and @ref LFT_FctType.
+ *
+ *  The time axis of a function is derived from its binWidth field;
+ *  set the duration of a binWidth unit with @ref TDC_setFitParams
+ *  (the TDC time base for functions retrieved from the device,
+ *  1 ps for functions calculated by this library).
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCFIT_H
+#define __TDCFIT_H
+
+#include "tdcdecl.h"
+#include "tdchbt.h"
+#include "tdclifetm.h"
+
+
+/** Start values of a batch fit
+ *
+ *  Selects where every single fit of a batch takes its start parameters.
+ */
+typedef enum {
+  FITSTART_GIVEN,        /**< All fits start from the given start parameters */
+  FITSTART_CHAIN,        /**< Every fit starts from the result of the preceeding
+                              function of the batch; useful for parameter scans.
+                              The batch is split in contiguous chunks per thread,
+                              the first fit of a chunk uses the given start
+                              parameters. */
+  FITSTART_PREVIOUS      /**< Every fit starts from the values found in its
+                              slot of the fitParams array, e.g. the result of
+                              a previous batch fit of the same functions. */
+} TDC_FitStart;
+
+
+/** Fit method of lifetime histograms */
+typedef enum {
+  FITMETHOD_LSQ,         /**< Least squares, like @ref TDC_fitLftHistogram */
+  FITMETHOD_MLE          /**< Poisson maximum likelihood. Unbiased for
+                              histograms with low counts and many empty bins.
+                              The model must be positive at all bins
+                              with counts for the start parameters. */
+} TDC_FitMethod;
+
+
+/** Result of a single fit */
+typedef struct {
+  Int32  iterations;     /**< Number of iterations in the fit process.
+                              Special Values: 0 = fit algorithm not called,
+                              -1 = fit algorithm failed */
+  Int32  evaluations;    /**< Number of model function evaluations */
+  double residual;       /**< Euclidean norm of the residual vector;
+                              Poisson deviance for @ref FITMETHOD_MLE */
+} TDC_FitResult;
+
+
+/** Set Fit Parameters
+ *
+ *  Sets the parameters that are common for all fits.
+ *  @param timebase  Duration of a binWidth unit of the fitted functions [s],
+ *                   default = 1e-12.
+ *  @param jitter    Typical detector jitter [s] used by the HBT model
+ *                   functions with jitter, default = 0.
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setFitParams( double timebase,
+                                     double jitter );
+
+
+/** Get Fit Parameters
+ *
+ *  Retrieves the parameters set by @ref TDC_setFitParams.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param timebase  Output: Duration of a binWidth unit [s]
+ *  @param jitter    Output: Typical detector jitter [s]
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getFitParams( double * timebase,
+                                     double * jitter );
+
+
+/** Set Number of Fit Threads
+ *
+ *  Sets the number of worker threads used for batch fits.
+ *  The thread pool is (re)created at the next batch fit.
+ *  @param threads   Number of threads, Range = 0 ... 256;
+ *                   0 (default) selects the number of CPU cores.
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setFitThreads( Int32 threads );
+
+
+/** Set Lifetime Fit Method
+ *
+ *  Selects the method for lifetime histogram fits
+ *  (@ref TDC_fitLftBatch and the live fit). g(2) functions are
+ *  normalized and always fitted by least squares.
+ *  @param method    Fit method, default = @ref FITMETHOD_LSQ
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setLftFitMethod( TDC_FitMethod method );
+
+
+/** Get Lifetime Fit Method
+ *
+ *  Retrieves the parameter set by @ref TDC_setLftFitMethod.
+ *  @param method    Output: Fit method
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getLftFitMethod( TDC_FitMethod * method );
+
+
+/** Set Instrument Response Function
+ *
+ *  Sets the instrument response function (IRF) for lifetime fits.
+ *  If set, the lifetime models are convolved with the IRF before they
+ *  are compared to the histogram ("reconvolution fit"); t = 0 of the
+ *  model corresponds to the first bin of the IRF and the histogram.
+ *  The IRF is normalized internally. Histograms to be fitted must have
+ *  the same bin width as the IRF.
+ *  @param irf       Input: Measured IRF, e.g. a histogram of scattered
+ *                   excitation light; NULL to fit without IRF (default).
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setLftIrf( const TDC_LftFunction * irf );
+
+
+/** Fit a Batch of g(2) Functions
+ *
+ *  Fits every function of the batch to the same model function.
+ *  @param count        Number of functions to fit
+ *  @param fcts         Input: Array of count g(2) functions
+ *  @param fitType      Type of function to fit to
+ *  @param start        Source of the start parameters
+ *  @param startParams  Input: Start values of the function parameters,
+ *                      array of @ref HBT_PARAM_SIZE elements.
+ *                      If NULL, the values of @ref TDC_getHbtFitStartParams
+ *                      are used. Ignored for @ref FITSTART_PREVIOUS.
+ *  @param fitParams    Input/Output: Array of count * @ref HBT_PARAM_SIZE
+ *                      elements receiving the fitted parameters of
+ *                      function i at index i * @ref HBT_PARAM_SIZE.
+ *                      Holds the start values for @ref FITSTART_PREVIOUS.
+ *  @param results      Output: Array of count fit results; may be NULL.
+ *  @return             Error code
+ */
+TDC_API int TDC_CC TDC_fitHbtBatch( Int32                           count,
+                                    const TDC_HbtFunction * const * fcts,
+                                    HBT_FctType                     fitType,
+                                    TDC_FitStart                    start,
+                                    const double                  * startParams,
+                                    double                        * fitParams,
+                                    TDC_FitResult                 * results );
+
+
+/** Fit a Batch of Lifetime Histograms
+ *
+ *  Fits every histogram of the batch to the same model function.
+ *  @param count        Number of histograms to fit
+ *  @param fcts         Input: Array of count histograms
+ *  @param fitType      Type of function to fit to
+ *  @param start        Source of the start parameters
+ *  @param startParams  Input: Start values of the function parameters,
+ *                      array of @ref LFT_PARAM_SIZE elements.
+ *                      Ignored for @ref FITSTART_PREVIOUS.
+ *  @param fitParams    Input/Output: Array of count * @ref LFT_PARAM_SIZE
+ *                      elements receiving the fitted parameters of
+ *                      histogram i at index i * @ref LFT_PARAM_SIZE.
+ *                      Holds the start values for @ref FITSTART_PREVIOUS.
+ *  @param results      Output: Array of count fit results; may be NULL.
+ *  @return             Error code; @ref TDC_OutOfRange if an IRF is set
+ *                      and a histogram has a different bin width.
+ */
+TDC_API int TDC_CC TDC_fitLftBatch( Int32                           count,
+                                    const TDC_LftFunction * const * fcts,
+                                    LFT_FctType                     fitType,
+                                    TDC_FitStart                    start,
+                                    const double                  * startParams,
+                                    double                        * fitParams,
+                                    TDC_FitResult                 * results );
+
+#endif
@@ -0,0 +1,239 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcflim.h
+ *
+ *  Purpose:        Pixel resolved lifetime histograms (FLIM)
+ *
+ */
+/*****************************************************************************/
+/** @file tdcflim.h
+ *  @brief Pixel resolved lifetime histograms (FLIM)
+ *
+ *  The header provides TCSPC imaging for scanning microscopes. The line
+ *  and frame clocks of the scanner are connected to TDC inputs or, more
+ *  commonly, to the marker inputs (see @ref TDC_enableMarkers). Every
+ *  stop event is assigned to a pixel by its time since the last line
+ *  clock and to a time bin by its delay to the last laser sync event.
+ *
+ *  The histograms are accumulated in a cube with pixel major layout:
+ *  the binCount bins of a pixel are contiguous, pixels follow in line
+ *  order. Element (x, y, bin) is found at index
+ *  (y * pixelsX + x) * binCount + bin. A completed frame is kept for
+ *  retrieval with @ref TDC_getFlimFrame while the next one is accumulated.
+ *
+ *  Channels are given as TDC channel numbers 1...32 or as marker channel
+ *  numbers 100...103 (rising edges) and 105...108 (falling edges) like
+ *  in the timestamp stream of @ref TDC_getLastTimestamps.
+ *
+ *  All times are given in the unit of the timestamps, i.e. ps.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCFLIM_H
+#define __TDCFLIM_H
+
+#include "tdcdecl.h"
+
+
+/** Enable FLIM
+ *
+ *  Enables the pixel assignment and histogram accumulation.
+ *  When disabled, the timestamps are ignored and the image buffers
+ *  are released. The function implicitly clears all data.
+ *  @param enable  Enable or disable
+ *  @return        Error code
+ */
+TDC_API int TDC_CC TDC_enableFlim( Bln32 enable );
+
+
+/** Set Image Parameters
+ *
+ *  Sets the geometry and timing of the scanned image.
+ *  If the function is not called, default values are in place.
+ *  When the function is called, all collected data are cleared.
+ *  @param pixelsX    Pixels per line, Range = 1 ... 4096, default = 256
+ *  @param linesY     Lines per frame, Range = 1 ... 4096, default = 256
+ *  @param pixelTime  Pixel dwell time [ps], Range = 1 ... 1G, default = 10M
+ *  @param lineDelay  Time from the line clock to the first pixel [ps],
+ *                    Range = 0 ... 1G, default = 0
+ *  @param frames     Number of scanned frames integrated into one frame
+ *                    delivered by @ref TDC_getFlimFrame,
+ *                    Range = 1 ... 1M, default = 1
+ *  @return           Error code; TDC_OutOfRange also if a frame would
+ *                    exceed 64M histogram bins.
+ */
+TDC_API int TDC_CC TDC_setFlimImage( Int32 pixelsX,
+                                     Int32 linesY,
+                                     Int32 pixelTime,
+                                     Int32 lineDelay,
+                                     Int32 frames );
+
+
+/** Get Image Parameters
+ *
+ *  Retrieves the parameters set by @ref TDC_setFlimImage.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param pixelsX    Output: Pixels per line
+ *  @param linesY     Output: Lines per frame
+ *  @param pixelTime  Output: Pixel dwell time [ps]
+ *  @param lineDelay  Output: Time from the line clock to the first pixel [ps]
+ *  @param frames     Output: Number of integrated frames
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_getFlimImage( Int32 * pixelsX,
+                                     Int32 * linesY,
+                                     Int32 * pixelTime,
+                                     Int32 * lineDelay,
+                                     Int32 * frames );
+
+
+/** Set Histogram Parameters
+ *
+ *  Sets the time axis of the pixel histograms.
+ *  If the function is not called, default values are in place.
+ *  When the function is called, all collected data are cleared.
+ *  @param binWidth  Width of a time bin [ps], Range = 1 ... 1M, default = 50
+ *  @param binCount  Number of time bins, Range = 1 ... 4096, default = 256
+ *  @return          Error code; TDC_OutOfRange also if a frame would
+ *                   exceed 64M histogram bins.
+ */
+TDC_API int TDC_CC TDC_setFlimHistogram( Int32 binWidth,
+                                         Int32 binCount );
+
+
+/** Get Histogram Parameters
+ *
+ *  Retrieves the parameters set by @ref TDC_setFlimHistogram.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param binWidth  Output: Width of a time bin [ps]
+ *  @param binCount  Output: Number of time bins
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getFlimHistogram( Int32 * binWidth,
+                                         Int32 * binCount );
+
+
+/** Set Input Channels
+ *
+ *  Selects the channels of the laser sync and the scanner clocks.
+ *  When the function is called, all collected data are cleared.
+ *  @param startChan  Laser sync channel, default = 1
+ *  @param lineChan   Line clock channel, default = 100
+ *  @param frameChan  Frame clock channel, default = 101;
+ *                    0 if there is no frame clock: a frame is complete
+ *                    after linesY lines.
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_setFlimInput( Int32 startChan,
+                                     Int32 lineChan,
+                                     Int32 frameChan );
+
+
+/** Get Input Channels
+ *
+ *  Retrieves the parameters set by @ref TDC_setFlimInput.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param startChan  Output: Laser sync channel
+ *  @param lineChan   Output: Line clock channel
+ *  @param frameChan  Output: Frame clock channel, 0 if none
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_getFlimInput( Int32 * startChan,
+                                     Int32 * lineChan,
+                                     Int32 * frameChan );
+
+
+/** Set Sync Divider
+ *
+ *  Sets the number of laser pulses per start event if the start input
+ *  of the device is divided (see @ref TDC_configureSyncDivider) without
+ *  reconstruction. The laser pulse train is then modelled by a period
+ *  and a phase that follow the received start events like a PLL, and
+ *  the delays of the stop events are calculated against the model, so
+ *  the skipped pulses needn't be generated. The model locks after two
+ *  start events; stop events before are ignored.
+ *  When the function is called, all collected data are cleared.
+ *  @param divider  Number of laser pulses per start event,
+ *                  Range = 1 ... 1024, default = 1 (no model).
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_setFlimSyncDivider( Int32 divider );
+
+
+/** Get Sync Divider
+ *
+ *  Retrieves the parameter set by @ref TDC_setFlimSyncDivider and the
+ *  state of the model.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param divider  Output: Number of laser pulses per start event
+ *  @param period   Output: Laser period estimated by the model [ps],
+ *                  0 if the model isn't locked or not in use.
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getFlimSyncDivider( Int32  * divider,
+                                           double * period );
+
+
+/** Add a Stop Channel
+ *
+ *  Adds or removes a detector channel. The events of all stop channels
+ *  contribute to the same histograms.
+ *  When the function is called, all collected data are cleared.
+ *  @param stopCh   Stop channel number, Range = 1 ... 32
+ *  @param add      Add (true) or remove (false) the channel
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_addFlimChannel( Int32 stopCh,
+                                       Bln32 add );
+
+
+/** Reset FLIM
+ *
+ *  Clears the image buffers and restarts the frame counting;
+ *  the next frame starts with the next frame (or line) clock.
+ *  @return  Error code
+ */
+TDC_API int TDC_CC TDC_resetFlim( void );
+
+
+/** Process Timestamps
+ *
+ *  Feeds timestamps to the image accumulation. The arrays have the format
+ *  delivered by @ref TDC_getLastTimestamps: timestamps in ps in increasing
+ *  order, channel numbers 0...31 for channels 1...32, 100...108 for markers.
+ *  @param timestamps Input: Array of timestamps
+ *  @param channels   Input: Array of corresponding channel numbers
+ *  @param count      Number of valid elements in both arrays
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_addFlimTimestamps( const Int64 * timestamps,
+                                          const Uint8 * channels,
+                                          Int32         count );
+
+
+/** Retrieve Frame
+ *
+ *  Retrieves the last completed frame.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param cube        Output: Histogram cube of the frame,
+ *                     pixelsX * linesY * binCount elements
+ *  @param cubeSize    Capacity of cube (number of elements)
+ *  @param intensity   Output: Photon counts per pixel, the sums of the
+ *                     pixel histograms; pixelsX * linesY elements
+ *  @param pixelCount  Capacity of intensity (number of elements)
+ *  @param frameNo     Output: Number of the frame, counting from 1
+ *                     since enable or reset
+ *  @return            Error code; TDC_NotAvailable if there is no
+ *                     completed frame yet, TDC_OutOfRange if a
+ *                     capacity is insufficient.
+ */
+TDC_API int TDC_CC TDC_getFlimFrame( Int32 * cube,
+                                     Int64   cubeSize,
+                                     Int32 * intensity,
+                                     Int32   pixelCount,
+                                     Int32 * frameNo );
+
+#endif
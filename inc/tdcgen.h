@@ -0,0 +1,197 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcgen.h
+ *
+ *  Purpose:        Synthetic event streams with photon statistics
+ *
+ */
+/*****************************************************************************/
+/** @file tdcgen.h
+ *  @brief Synthetic event streams with photon statistics
+ *
+ *  The header provides a generator of timestamp streams for load tests
+ *  and for the validation of analyses without a device. Unlike
+ *  @ref TDC_generateTimestamps, every channel follows its own model of
+ *  photon statistics (@ref TDC_GenModel), e.g. Poisson light, bunched
+ *  or antibunched light, fluorescence excited by a pulsed laser or
+ *  bursts of a diffusing molecule, optionally with the laser sync on
+ *  another channel.
+ *
+ *  The random numbers come from a counter-based generator: the n-th
+ *  number of a stream is a hash of the stream key and n. Memoryless
+ *  models are split into time slices with independent streams that are
+ *  generated in parallel on a pool of worker threads. The result only
+ *  depends on the seed and the configuration, not on the number of
+ *  threads or the sizes of the retrieved blocks.
+ *
+ *  Rates are given in events per second, times in ps. Events come in
+ *  the format of @ref TDC_getLastTimestamps: timestamps in ps in
+ *  increasing order, channel numbers 0...31 for channels 1...32.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCGEN_H
+#define __TDCGEN_H
+
+#include "tdcdecl.h"
+
+#define TDC_GEN_PARAMS  4            /**< Number of model parameters */
+
+
+/** Generator Model of a Channel */
+typedef enum {
+  GEN_OFF,               /**< No events */
+  GEN_POISSON,           /**< Poisson process (coherent light).
+                              par[0]: rate */
+  GEN_BUNCHED,           /**< Bunched light with g(2)(t) = 1 + exp(-|t| / tc),
+                              like thermal light.
+                              par[0]: mean rate, par[1]: correlation time tc */
+  GEN_ANTIBUNCHED,       /**< Single two level emitter with
+                              g(2)(t) = 1 - exp(-|t| (1 / tau + r)).
+                              par[0]: excitation rate r,
+                              par[1]: lifetime tau,
+                              par[2]: detection efficiency, 0 ... 1 */
+  GEN_PULSED,            /**< Fluorescence excited by the pulsed laser,
+                              see @ref TDC_setGenLaser.
+                              par[0]: detection probability per pulse, 0 ... 1,
+                              par[1]: lifetime, 0 for no decay,
+                              par[2]: delay to the laser pulse */
+  GEN_BURST              /**< Bursts with random durations and gaps on a
+                              Poisson background.
+                              par[0]: rate during a burst,
+                              par[1]: mean burst duration,
+                              par[2]: mean time between bursts,
+                              par[3]: background rate */
+} TDC_GenModel;
+
+
+/** Set Channel Model
+ *
+ *  Sets the model that generates the events of a channel.
+ *  By default, all channels are @ref GEN_OFF.
+ *  The new model applies to events generated after the call;
+ *  events generated before but not yet retrieved are kept.
+ *  @param channel  Channel number, Range = 1 ... 32
+ *  @param model    Model
+ *  @param par      Input: Array of @ref TDC_GEN_PARAMS model parameters,
+ *                  see @ref TDC_GenModel; unused ones are ignored.
+ *                  Rates range from 0 to 10G events/s (excitation rates
+ *                  to 1T), times from 1 ps to 1 s (lifetimes and delays
+ *                  from 0 to 1 ms).
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_setGenChannel( Int32          channel,
+                                      TDC_GenModel   model,
+                                      const double * par );
+
+
+/** Get Channel Model
+ *
+ *  Retrieves the parameters set by @ref TDC_setGenChannel.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param channel  Channel number, Range = 1 ... 32
+ *  @param model    Output: Model
+ *  @param par      Output: Array of @ref TDC_GEN_PARAMS model parameters
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getGenChannel( Int32          channel,
+                                      TDC_GenModel * model,
+                                      double       * par );
+
+
+/** Set Laser Parameters
+ *
+ *  Sets the pulsed laser used by @ref GEN_PULSED. Its pulses occur at
+ *  multiples of the period. If a sync channel is given, every pulse
+ *  generates an event there, in addition to the events of the model of
+ *  that channel.
+ *  @param period    Laser repetition period [ps], Range = 1 ... 1G,
+ *                   default = 12500 (80 MHz).
+ *  @param syncChan  Channel of the laser sync, Range = 0 ... 32;
+ *                   default = 0: no sync events.
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setGenLaser( Int32 period,
+                                    Int32 syncChan );
+
+
+/** Get Laser Parameters
+ *
+ *  Retrieves the parameters set by @ref TDC_setGenLaser.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param period    Output: Laser repetition period [ps]
+ *  @param syncChan  Output: Channel of the laser sync, 0 if none
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getGenLaser( Int32 * period,
+                                    Int32 * syncChan );
+
+
+/** Set Number of Generator Threads
+ *
+ *  Sets the number of worker threads of the generator.
+ *  The thread pool is (re)created at the next generation.
+ *  @param threads   Number of threads, Range = 0 ... 256;
+ *                   0 (default) selects the number of CPU cores.
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setGenThreads( Int32 threads );
+
+
+/** Reset Generator
+ *
+ *  Restarts the generation at time 0 with a new seed and discards
+ *  events not yet retrieved. The configuration is kept.
+ *  If the function is not called, the seed is 0.
+ *  @param seed      Seed of the random number streams
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_resetGen( Int64 seed );
+
+
+/** Generate Timestamps
+ *
+ *  Generates the next events of the stream.
+ *  @param timestamps Output: Array of timestamps, size elements
+ *  @param channels   Output: Array of channel numbers, size elements
+ *  @param size       Size of the arrays
+ *  @param count      Output: Number of events, equals size
+ *  @return           Error code; @ref TDC_NotEnabled if no channel
+ *                    generates events.
+ */
+TDC_API int TDC_CC TDC_genTimestamps( Int64 * timestamps,
+                                      Uint8 * channels,
+                                      Int32   size,
+                                      Int32 * count );
+
+
+/** Generate and Input Timestamps
+ *
+ *  Generates the next events of the stream and passes them to the
+ *  device library with @ref TDC_inputTimestamps, so they are
+ *  processed like the data of a device.
+ *  @param count      Number of events
+ *  @return           Error code; @ref TDC_NotEnabled if no channel
+ *                    generates events.
+ */
+TDC_API int TDC_CC TDC_genInputTimestamps( Int64 count );
+
+
+/** Generator State
+ *
+ *  Retrieves the progress of the generator since the last reset.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param time      Output: Time up to which events have been generated [ps]
+ *  @param events    Output: Number of events retrieved
+ *  @param rate      Output: Expected total event rate of the
+ *                   configuration [events/s]
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getGenInfo( Int64  * time,
+                                   Int64  * events,
+                                   double * rate );
+
+#endif
@@ -0,0 +1,232 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdchg2tcp.h
+ *
+ *  Purpose:        Sparse triple coincidence map for heralded g(2)
+ *
+ */
+/*****************************************************************************/
+/** @file tdchg2tcp.h
+ *  @brief Sparse triple coincidence map for heralded g(2)
+ *
+ *  The header provides triple coincidence ("TCP") accumulators like
+ *  @ref TDC_calcHg2Tcp with a memory footprint that depends on the
+ *  populated area of the map rather than on its size.
+ *
+ *  A configuration consists of an idler and two signal channels.
+ *  For every combination of an idler event and events on both signal
+ *  channels with delays a = t(signal1) - t(idler) and
+ *  b = t(signal2) - t(idler) in the range 0 ... binWidth * binCount,
+ *  bin (a / binWidth, b / binWidth) of the map is incremented.
+ *  The map is divided into square tiles that are allocated when the
+ *  first event falls into them. Only these tiles are stored and
+ *  retrieved with @ref TDC_getHg2TcpTiles.
+ *
+ *  Any number of configurations can be evaluated in a single pass,
+ *  e.g. several heralds or all pairs of a detector array; channels
+ *  may be shared between configurations. Every configuration has its
+ *  own map, coincidence counts and heralded g(2), see
+ *  @ref TDC_getHg2TcpG2.
+ *
+ *  All times are given in the unit of the timestamps, i.e. ps.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCHG2TCP_H
+#define __TDCHG2TCP_H
+
+#include "tdcdecl.h"
+
+
+/** Position of a Tile
+ *
+ *  A tile of size n holds the map bins (bin1 ... bin1+n-1, bin2 ... bin2+n-1).
+ */
+typedef struct {
+  Int32 bin1;                     /**< First bin on the signal 1 axis */
+  Int32 bin2;                     /**< First bin on the signal 2 axis */
+} TDC_Hg2Tile;
+
+
+/** Enable Triple Coincidence Map
+ *
+ *  Enables the accumulation. When disabled, the timestamps are
+ *  ignored and the map is released.
+ *  The function implicitly clears the map.
+ *  @param enable  Enable or disable
+ *  @return        Error code
+ */
+TDC_API int TDC_CC TDC_enableHg2Tcp( Bln32 enable );
+
+
+/** Set Map Parameters
+ *
+ *  Sets the bin structure of the map.
+ *  If the function is not called, default values are in place.
+ *  When the function is called, all collected data are cleared.
+ *  @param binWidth  Width of a bin [ps], Range = 1 ... 1M, default = 100
+ *  @param binCount  Number of bins per axis, Range = 16 ... 64k, default = 256
+ *  @param tileSize  Number of bins per tile and axis,
+ *                   Range = 8, 16, 32, 64, 128, 256; default = 32
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setHg2TcpParams( Int32 binWidth,
+                                        Int32 binCount,
+                                        Int32 tileSize );
+
+
+/** Get Map Parameters
+ *
+ *  Retrieves the parameters set by @ref TDC_setHg2TcpParams.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param binWidth  Output: Width of a bin [ps]
+ *  @param binCount  Output: Number of bins per axis
+ *  @param tileSize  Output: Number of bins per tile and axis
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getHg2TcpParams( Int32 * binWidth,
+                                        Int32 * binCount,
+                                        Int32 * tileSize );
+
+
+/** Add a Configuration
+ *
+ *  Adds an idler and a pair of signal channels to be evaluated.
+ *  When the function is called, all collected data are cleared.
+ *  @param idler     Idler  channel number, Range = 1...32
+ *  @param channel1  First  signal channel number, Range = 1...32
+ *  @param channel2  Second signal channel number, Range = 1...32
+ *  @param config    Output: Index of the configuration, counting from 0;
+ *                   may be NULL.
+ *  @return          Error code; TDC_OutOfRange also if the channels
+ *                   are not distinct or there are already 256 configurations.
+ */
+TDC_API int TDC_CC TDC_addHg2TcpConfig( Int32   idler,
+                                        Int32   channel1,
+                                        Int32   channel2,
+                                        Int32 * config );
+
+
+/** Remove all Configurations
+ *
+ *  Removes all configurations and their data.
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_clearHg2TcpConfigs( void );
+
+
+/** Get Configuration
+ *
+ *  Retrieves a configuration added by @ref TDC_addHg2TcpConfig.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param config    Index of the configuration
+ *  @param idler     Output: Idler  channel number
+ *  @param channel1  Output: First  signal channel number
+ *  @param channel2  Output: Second signal channel number
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getHg2TcpConfig( Int32   config,
+                                        Int32 * idler,
+                                        Int32 * channel1,
+                                        Int32 * channel2 );
+
+
+/** Get Number of Configurations
+ *
+ *  @param count     Output: Number of configurations
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getHg2TcpConfigCount( Int32 * count );
+
+
+/** Reset Triple Coincidence Map
+ *
+ *  Clears the maps of all configurations and releases their tiles.
+ *  @return  Error code
+ */
+TDC_API int TDC_CC TDC_resetHg2Tcp( void );
+
+
+/** Process Timestamps
+ *
+ *  Feeds timestamps to the accumulator. The arrays have the format
+ *  delivered by @ref TDC_getLastTimestamps: timestamps in ps in increasing
+ *  order, channel numbers 0...31 for channels 1...32.
+ *  @param timestamps Input: Array of timestamps
+ *  @param channels   Input: Array of corresponding channel numbers
+ *  @param count      Number of valid elements in both arrays
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_addHg2TcpTimestamps( const Int64 * timestamps,
+                                            const Uint8 * channels,
+                                            Int32         count );
+
+
+/** Map Statistics
+ *
+ *  Retrieves the size of the populated map and event counts
+ *  of a configuration.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param config    Index of the configuration
+ *  @param tiles     Output: Number of allocated tiles
+ *  @param evtIdler  Output: Number of idler events
+ *  @param coinc1    Output: Number of coincidences idler + signal 1
+ *                   in the range of the map
+ *  @param coinc2    Output: Number of coincidences idler + signal 2
+ *                   in the range of the map
+ *  @param triples   Output: Number of triple coincidences in the map
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getHg2TcpInfo( Int32   config,
+                                      Int32 * tiles,
+                                      Int64 * evtIdler,
+                                      Int64 * coinc1,
+                                      Int64 * coinc2,
+                                      Int64 * triples );
+
+
+/** Heralded g(2)
+ *
+ *  Calculates the heralded g(2) of a configuration for a coincidence
+ *  window of the first bins after the idler:
+ *  g2 = N(i) * N(1,2,i) / (N(1,i) * N(2,i)), where N(1,i), N(2,i)
+ *  and N(1,2,i) count the coincidences with both delays in the window.
+ *  @param config    Index of the configuration
+ *  @param window    Coincidence window [bins], Range = 1 ... binCount
+ *  @param g2        Output: Heralded g(2)
+ *  @return          Error code; TDC_NotAvailable if there are no
+ *                   coincidences in the window.
+ */
+TDC_API int TDC_CC TDC_getHg2TcpG2( Int32    config,
+                                    Int32    window,
+                                    double * g2 );
+
+
+/** Retrieve Tiles
+ *
+ *  Retrieves the allocated tiles of the map of a configuration,
+ *  ordered by bin2, then bin1.
+ *  Bins outside the tiles are empty.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param config   Index of the configuration
+ *  @param tiles    Output: Positions of the tiles
+ *  @param buffer   Output: Event counts of the tiles. Tile i occupies
+ *                  tileSize^2 elements from i * tileSize^2 on; element
+ *                  a + b * tileSize holds the bin (bin1 + a, bin2 + b).
+ *  @param count    Input: Number of tiles that fit into the arrays
+ *                  Output: Number of allocated tiles
+ *  @param reset    If the data of the configuration should be cleared
+ *                  after the call
+ *  @return         Error code; TDC_OutOfRange if the arrays are too
+ *                  small, count is set to the required size then.
+ */
+TDC_API int TDC_CC TDC_getHg2TcpTiles( Int32         config,
+                                       TDC_Hg2Tile * tiles,
+                                       Int64       * buffer,
+                                       Int32       * count,
+                                       Bln32         reset );
+
+#endif
@@ -0,0 +1,155 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdclivefit.h
+ *
+ *  Purpose:        Background fitting during accumulation
+ *
+ */
+/*****************************************************************************/
+/** @file tdclivefit.h
+ *  @brief Background fitting during accumulation
+ *
+ *  When enabled, a background thread periodically retrieves the current
+ *  g(2) function (@ref TDC_calcHbtG2) or a lifetime histogram
+ *  (@ref TDC_getLftHistogram) and fits it to the selected model.
+ *  Every fit starts from the result of the previous one, so that
+ *  a refit typically converges in a few iterations. If no new events
+ *  have been accumulated since the last fit, the fit is skipped.
+ *
+ *  The latest parameters and their standard errors are retrieved with
+ *  @ref TDC_getLiveFitResult without blocking on the fit.
+ *
+ *  The HBT or lifetime calculation must be configured and enabled
+ *  with the functions of tdchbt.h or tdclifetm.h. The fits use the
+ *  TDC time base and the detector jitter set with
+ *  @ref TDC_setHbtDetectorParams; lifetime histograms are fitted
+ *  with the method selected by @ref TDC_setLftFitMethod.
+ *
+ *  The data are retrieved from the device selected with
+ *  @ref TDC_setLiveFitDevice. The calls are serialized with the calls
+ *  of the device handle API (tdcdevice.h) from other threads.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCLIVEFIT_H
+#define __TDCLIVEFIT_H
+
+#include "tdcdecl.h"
+#include "tdcfit.h"
+#include "tdcdevice.h"
+
+
+/** Enable Live Fitting
+ *
+ *  Starts or stops the background fit thread.
+ *  Enabling discards the previous result.
+ *  @param enable   Enable or disable
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_enableLiveFit( Bln32 enable );
+
+
+/** Select g(2) Live Fit
+ *
+ *  Selects the g(2) function as data source of the live fit.
+ *  Discards the previous result.
+ *  @param fitType      Type of function to fit to
+ *  @param startParams  Input: Start values of the function parameters,
+ *                      array of @ref HBT_PARAM_SIZE elements.
+ *                      If NULL, the values of @ref TDC_getHbtFitStartParams
+ *                      are used.
+ *  @return             Error code
+ */
+TDC_API int TDC_CC TDC_setLiveFitHbt( HBT_FctType    fitType,
+                                      const double * startParams );
+
+
+/** Select Lifetime Live Fit
+ *
+ *  Selects a lifetime histogram as data source of the live fit.
+ *  Discards the previous result.
+ *  @param channel      Stop channel of the histogram, Range = 0 ... 32,
+ *                      see @ref TDC_getLftHistogram
+ *  @param fitType      Type of function to fit to
+ *  @param startParams  Input: Start values of the function parameters,
+ *                      array of @ref LFT_PARAM_SIZE elements.
+ *  @return             Error code
+ */
+TDC_API int TDC_CC TDC_setLiveFitLft( Int32          channel,
+                                      LFT_FctType    fitType,
+                                      const double * startParams );
+
+
+/** Select Live Fit Device
+ *
+ *  Selects the device whose data are fitted. When the function returns,
+ *  the previously selected device isn't accessed anymore, so it may be
+ *  closed. A selected device must not be closed.
+ *  Discards the previous result.
+ *  @param dev      Device handle; NULL (default) for the device addressed
+ *                  with @ref TDC_addressDevice.
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_setLiveFitDevice( TDC_Device * dev );
+
+
+/** Get Live Fit Device
+ *
+ *  Retrieves the parameter set by @ref TDC_setLiveFitDevice.
+ *  @param dev      Output: Device handle, NULL for the addressed device
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getLiveFitDevice( TDC_Device ** dev );
+
+
+/** Set Live Fit Interval
+ *
+ *  Sets the time between two fits.
+ *  @param interval  Interval [ms], Range = 10 ... 60000, default = 1000
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setLiveFitInterval( Int32 interval );
+
+
+/** Get Live Fit Interval
+ *
+ *  Retrieves the parameter set by @ref TDC_setLiveFitInterval.
+ *  @param interval  Output: Interval [ms]
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getLiveFitInterval( Int32 * interval );
+
+
+/** Reset Live Fit
+ *
+ *  Discards the previous result; the next fit starts from the
+ *  start parameters again.
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_resetLiveFit( void );
+
+
+/** Retrieve Live Fit Result
+ *
+ *  Retrieves the result of the latest live fit.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param fitParams  Output: Fitted parameters, array of
+ *                    @ref HBT_PARAM_SIZE or @ref LFT_PARAM_SIZE elements
+ *                    depending on the data source.
+ *  @param errors     Output: Standard errors of the fitted parameters,
+ *                    same size as fitParams; 0 if undetermined.
+ *  @param result     Output: Statistics of the fit
+ *  @param sequence   Output: Number of fits since the result was
+ *                    discarded; changes when a new result is available.
+ *  @return           Error code; @ref TDC_NotAvailable if there is no
+ *                    result yet.
+ */
+TDC_API int TDC_CC TDC_getLiveFitResult( double        * fitParams,
+                                         double        * errors,
+                                         TDC_FitResult * result,
+                                         Int32         * sequence );
+
+#endif
@@ -0,0 +1,187 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcmerge.h
+ *
+ *  Purpose:        Merged event stream of synchronized devices
+ *
+ */
+/*****************************************************************************/
+/** @file tdcmerge.h
+ *  @brief Merged event stream of synchronized devices
+ *
+ *  Devices that share a clock (see @ref TDC_getClockState,
+ *  @ref TDC_enableExternalClock) deliver timestamps on a common time base,
+ *  but every device delivers its own stream. The functions of this header
+ *  merge the streams of several devices into one stream in time order,
+ *  so analyses can use channels of different devices.
+ *
+ *  The timestamps of every device are fed with
+ *  @ref TDC_addDeviceMergeTimestamps, typically as received from
+ *  @ref TDC_devGetLastTimestamps. They are held in a buffer per device
+ *  until all devices have delivered data up to the same time, the
+ *  watermark. Only events up to the watermark are merged and can be
+ *  retrieved with @ref TDC_getDeviceMergeTimestamps.
+ *
+ *  A device without events would hold back the watermark forever.
+ *  Therefore a device whose newest event lags behind the newest event
+ *  of all devices by more than a configurable time is ignored for the
+ *  watermark. A device that hasn't delivered any events yet is waited
+ *  for until the newest event is that much later than the first event
+ *  of all devices. Events that arrive after the watermark has passed them
+ *  are discarded and counted as late. Events that don't fit into a
+ *  full device buffer are discarded and counted as lost.
+ *
+ *  In the merged stream, channel c (0...31) of device d has the number
+ *  d * 32 + c. Markers and the millisecond tick (100...108) of
+ *  device d get the number @ref TDC_MERGE_MARKER + d * 16 + (m - 100).
+ *
+ *  All times are given in the unit of the timestamps, i.e. ps, if
+ *  not stated otherwise.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCMERGE_H
+#define __TDCMERGE_H
+
+#include "tdcdecl.h"
+
+#define TDC_MERGE_DEVICES   8     /**< Max. number of merged devices */
+#define TDC_MERGE_MARKER  256     /**< First channel number of markers */
+
+
+/** Enable Merging
+ *
+ *  Enables the merging. When disabled, the timestamps are ignored.
+ *  The function implicitly clears the buffers.
+ *  @param enable  Enable or disable
+ *  @return        Error code
+ */
+TDC_API int TDC_CC TDC_enableDeviceMerge( Bln32 enable );
+
+
+/** Set Merge Parameters
+ *
+ *  If the function is not called, default values are in place.
+ *  When the function is called, all collected data are cleared.
+ *  @param devices    Number of devices, Range = 1 ... 8, default = 2
+ *  @param bufferSize Capacity of the buffer of every device [events],
+ *                    Range = 1024 ... 67,108,864, default = 1,048,576
+ *  @param maxLag     Max. lag of a device behind the newest event before
+ *                    it is ignored for the watermark,
+ *                    Range = 0 ... 1,000,000,000,000,000, default =
+ *                    1,000,000,000 (1ms); 0 means the merging always waits
+ *                    for all devices.
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_setDeviceMergeParams( Int32 devices,
+                                             Int32 bufferSize,
+                                             Int64 maxLag );
+
+
+/** Get Merge Parameters
+ *
+ *  Retrieves the parameters set by @ref TDC_setDeviceMergeParams.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param devices    Output: Number of devices
+ *  @param bufferSize Output: Capacity of the buffer of every device
+ *  @param maxLag     Output: Max. lag of a device
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_getDeviceMergeParams( Int32 * devices,
+                                             Int32 * bufferSize,
+                                             Int64 * maxLag );
+
+
+/** Set Device Time Offset
+ *
+ *  Sets an offset that is added to the timestamps of a device,
+ *  e.g. to compensate for the delay of the clock distribution.
+ *  When the function is called, all collected data are cleared.
+ *  @param device   Index of the device, Range = 0 ... devices-1
+ *  @param offset   Offset [ps], Range = -1,000,000,000 ... 1,000,000,000,
+ *                  default = 0
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_setDeviceMergeOffset( Int32 device,
+                                             Int32 offset );
+
+
+/** Get Device Time Offset
+ *
+ *  Retrieves the parameter set by @ref TDC_setDeviceMergeOffset.
+ *  @param device   Index of the device, Range = 0 ... devices-1
+ *  @param offset   Output: Offset [ps]
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getDeviceMergeOffset( Int32   device,
+                                             Int32 * offset );
+
+
+/** Reset Merging
+ *
+ *  Clears the buffers and the counters.
+ *  @return  Error code
+ */
+TDC_API int TDC_CC TDC_resetDeviceMerge( void );
+
+
+/** Feed Timestamps of a Device
+ *
+ *  Adds timestamps of a device to its buffer. The arrays have the format
+ *  delivered by @ref TDC_getLastTimestamps: timestamps in ps in increasing
+ *  order, channel numbers 0...31 for channels 1...32, 100...108 for
+ *  markers and the millisecond tick.
+ *  @param device     Index of the device, Range = 0 ... devices-1
+ *  @param timestamps Input: Array of timestamps
+ *  @param channels   Input: Array of corresponding channel numbers
+ *  @param count      Number of valid elements in both arrays
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_addDeviceMergeTimestamps( Int32         device,
+                                                 const Int64 * timestamps,
+                                                 const Uint8 * channels,
+                                                 Int32         count );
+
+
+/** Retrieve Merged Timestamps
+ *
+ *  Retrieves the merged events up to the watermark, oldest first, and
+ *  removes them from the buffers. If there are more events than fit into
+ *  the arrays, the remaining ones are kept for the next call. Events with
+ *  equal timestamps are ordered by device.
+ *  @param timestamps Output: Array of timestamps
+ *  @param channels   Output: Array of merged channel numbers, see above
+ *  @param count      Input: Number of elements of both arrays
+ *                    Output: Number of events retrieved
+ *  @param flush      Ignore the watermark and retrieve all buffered events,
+ *                    e.g. at the end of a measurement
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_getDeviceMergeTimestamps( Int64 * timestamps,
+                                                 Int32 * channels,
+                                                 Int32 * count,
+                                                 Bln32   flush );
+
+
+/** Merging State
+ *
+ *  Retrieves information about the merging.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param watermark  Output: Time up to which all devices have delivered
+ *                    their events
+ *  @param buffered   Output: Number of events in the buffers of all devices
+ *  @param lost       Output: Number of events discarded because of a
+ *                    full buffer since the last reset
+ *  @param late       Output: Number of events discarded because they
+ *                    arrived behind the watermark since the last reset
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_getDeviceMergeInfo( Int64 * watermark,
+                                           Int32 * buffered,
+                                           Int64 * lost,
+                                           Int64 * late );
+
+#endif
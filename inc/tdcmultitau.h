@@ -0,0 +1,200 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcmultitau.h
+ *
+ *  Purpose:        Multi-tau correlation with logarithmic lag axis
+ *
+ */
+/*****************************************************************************/
+/** @file tdcmultitau.h
+ *  @brief Multi-tau correlation with logarithmic lag axis
+ *
+ *  The header provides a software correlator for fluorescence correlation
+ *  spectroscopy (FCS) style g(2) functions. Unlike the linear bins of
+ *  @ref TDC_setHbtParams, the lag axis is organized in stages: stage 0 has
+ *  binsPerStage bins of binWidth, every following stage doubles the bin width
+ *  and adds binsPerStage/2 bins. The lag range thereby grows exponentially
+ *  with the number of stages while memory and processing time per event
+ *  grow only linearly.
+ *
+ *  Set parameters with @ref TDC_setMultiTauParams and
+ *  @ref TDC_setMultiTauInput, enable the correlator with
+ *  @ref TDC_enableMultiTau and feed timestamps (e.g. retrieved with
+ *  @ref TDC_getLastTimestamps) with @ref TDC_addMultiTauTimestamps.
+ *  Use @ref TDC_calcMultiTauG2 to calculate the normalized g(2) function.
+ *
+ *  All times are given in the unit of the timestamps, i.e. ps.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCMULTITAU_H
+#define __TDCMULTITAU_H
+
+#include "tdcdecl.h"
+
+
+/** Multi-tau g(2) Function
+ *
+ *  The struct transports a g(2) function with non-uniform lag axis.
+ *  Both arrays have capacity elements; size of them are valid.
+ *  lags[i] is the time difference belonging to values[i]; the lag axis
+ *  is strictly increasing and symmetric around lags[indexOffset] = 0.
+ *  Negative lags denote events on channel 2 preceeding those on channel 1.
+ *
+ *  It is recommended to create the struct using
+ *  @ref TDC_createMultiTauFunction after the last call of
+ *  @ref TDC_setMultiTauParams.
+ */
+typedef struct {
+  Int32    capacity;    /**< Array size of lags and values */
+  Int32    size;        /**< Number of valid items in lags and values */
+  Int32    indexOffset; /**< Index for element of values that represents t=0 */
+  Int64  * lags;        /**< Array of time differences [ps] */
+  double * values;      /**< Array of function values */
+} TDC_MultiTauFunction;
+
+
+/** Enable Multi-tau Correlator
+ *
+ *  Enables the multi-tau correlator. When enabled, all timestamps
+ *  passed to @ref TDC_addMultiTauTimestamps on the selected channels
+ *  contribute to the correlation. When disabled, the timestamps are ignored
+ *  and the accumulated data are released.
+ *  The function implicitly clears the correlation.
+ *  @param enable  Enable or disable
+ *  @return        Error code
+ */
+TDC_API int TDC_CC TDC_enableMultiTau( Bln32 enable );
+
+
+/** Set Multi-tau Parameters
+ *
+ *  Sets the lag axis of the correlator.
+ *  If the function is not called, default values are in place.
+ *  When the function is called, all collected data are cleared.
+ *  The covered lag range is binWidth * binsPerStage * 2^(stageCount-1).
+ *  @param binWidth     Width of a bin of the first stage [ps],
+ *                      Range = 1 ... 1M, default = 1000.
+ *  @param binsPerStage Number of bins of the first stage; every following
+ *                      stage contributes half of them. Must be even,
+ *                      Range = 4 ... 256, default = 16.
+ *  @param stageCount   Number of stages, Range = 1 ... 40, default = 24.
+ *  @return             Error code; @ref TDC_OutOfRange also if the covered
+ *                      lag range exceeds 2^63 ps.
+ */
+TDC_API int TDC_CC TDC_setMultiTauParams( Int32 binWidth,
+                                          Int32 binsPerStage,
+                                          Int32 stageCount );
+
+
+/** Get Multi-tau Parameters
+ *
+ *  Retrieves the parameters set by @ref TDC_setMultiTauParams.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param binWidth     Output: Width of a bin of the first stage [ps]
+ *  @param binsPerStage Output: Number of bins of the first stage
+ *  @param stageCount   Output: Number of stages
+ *  @return             Error code
+ */
+TDC_API int TDC_CC TDC_getMultiTauParams( Int32 * binWidth,
+                                          Int32 * binsPerStage,
+                                          Int32 * stageCount );
+
+
+/** Set TDC Channels for Input
+ *
+ *  Sets the channels to correlate. If both channels are equal, the
+ *  autocorrelation is calculated.
+ *  The function implicitly clears the correlation.
+ *  @param channel1  First  channel number, Range = 1...32, default = 1
+ *  @param channel2  Second channel number, Range = 1...32, default = 2
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setMultiTauInput( Int32 channel1,
+                                         Int32 channel2 );
+
+
+/** Get TDC Channels for Input
+ *
+ *  Retrieves the parameters set by @ref TDC_setMultiTauInput.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param channel1  Output: First  channel number
+ *  @param channel2  Output: Second channel number
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getMultiTauInput( Int32 * channel1,
+                                         Int32 * channel2 );
+
+
+/** Reset Correlation
+ *
+ *  Clears the accumulated correlation.
+ *  @return  Error code
+ */
+TDC_API int TDC_CC TDC_resetMultiTau( void );
+
+
+/** Process Timestamps
+ *
+ *  Feeds timestamps to the correlator. The arrays have the format
+ *  delivered by @ref TDC_getLastTimestamps: timestamps in ps in increasing
+ *  order, channel numbers 0...31 for channels 1...32.
+ *  @param timestamps Input: Array of timestamps
+ *  @param channels   Input: Array of corresponding channel numbers
+ *  @param count      Number of valid elements in both arrays
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_addMultiTauTimestamps( const Int64 * timestamps,
+                                              const Uint8 * channels,
+                                              Int32         count );
+
+
+/** Retrieve Event Count and Integration Time
+ *
+ *  Retrieves the number of events contributing to the correlation
+ *  and the time span covered by them.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param count1   Output: Number of events on the first channel
+ *  @param count2   Output: Number of events on the second channel
+ *  @param intTime  Output: Integration time [ps], 0 if no events
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getMultiTauEventCount( Int64 * count1,
+                                              Int64 * count2,
+                                              Int64 * intTime );
+
+
+/** Calculate g(2) Function
+ *
+ *  Calculates the normalized g(2) function from the current state of
+ *  the correlator. A value of 1 corresponds to uncorrelated events.
+ *  @param fct      Output: Function description. If the capacity
+ *                  of the buffer is not sufficient, TDC_OutOfRange
+ *                  will be returned.
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_calcMultiTauG2( TDC_MultiTauFunction * fct );
+
+
+/** Create Function Description
+ *
+ *  Creates a function description buffer by allocating memory
+ *  according to the current parameters (see @ref TDC_setMultiTauParams).
+ *  Release a buffer with @ref TDC_releaseMultiTauFunction.
+ *  @return  Address of a newly created buffer; NULL on error
+ */
+TDC_API TDC_MultiTauFunction * TDC_CC TDC_createMultiTauFunction( void );
+
+
+/** Release Function Description
+ *
+ *  Releases the memory allocated for a funcion description.
+ *  @param fct      Function description to free.
+ *                  After the call, the pointer is invalid!
+ */
+TDC_API void TDC_CC TDC_releaseMultiTauFunction( TDC_MultiTauFunction * fct );
+
+#endif
@@ -0,0 +1,229 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcphasor.h
+ *
+ *  Purpose:        Phasor lifetime analysis of start-stop delays
+ *
+ */
+/*****************************************************************************/
+/** @file tdcphasor.h
+ *  @brief Phasor lifetime analysis of start-stop delays
+ *
+ *  The header provides a streaming phasor accumulator. For every stop
+ *  event, the delay to the preceding start event is mapped to the phase
+ *  of the excitation period, and the cosine and sine of the phase are
+ *  summed per stop channel. The phasor coordinates
+ *  g = <cos(n w t)>, s = <sin(n w t)> at the harmonic n of the laser
+ *  repetition frequency w / 2pi give a lifetime estimate without a fit:
+ *  a single exponential decay with lifetime tau lies on the universal
+ *  circle at g = 1 / (1 + (n w tau)^2), s = n w tau g.
+ *
+ *  The cosine and sine values are taken from tables with one entry per
+ *  delay bin, so the cost per event is a division and two additions.
+ *
+ *  Set parameters with @ref TDC_setPhasorParams, select the channels with
+ *  @ref TDC_setPhasorStartInput and @ref TDC_addPhasorChannel and enable
+ *  the accumulator with @ref TDC_enablePhasor. Feed timestamps with
+ *  @ref TDC_addPhasorTimestamps and retrieve the results with
+ *  @ref TDC_getPhasor and @ref TDC_getPhasorLifetime.
+ *
+ *  All times are given in the unit of the timestamps, i.e. ps.
+ */
+/*****************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCPHASOR_H
+#define __TDCPHASOR_H
+
+#include "tdcdecl.h"
+
+
+/** Enable Phasor Calculation
+ *
+ *  Enables the phasor accumulation. When disabled, the timestamps are
+ *  ignored and the accumulated data are released.
+ *  The function implicitly clears the accumulated data.
+ *  @param enable  Enable or disable
+ *  @return        Error code
+ */
+TDC_API int TDC_CC TDC_enablePhasor( Bln32 enable );
+
+
+/** Set Phasor Parameters
+ *
+ *  Sets the excitation period and the resolution of the phase tables.
+ *  If the function is not called, default values are in place.
+ *  When the function is called, all collected data and the calibration
+ *  are cleared.
+ *  @param period    Laser repetition period [ps], Range = 1 ... 1G,
+ *                   default = 12500 (80 MHz).
+ *  @param binWidth  Delay resolution of the phase tables [ps],
+ *                   Range = 1 ... period, default = 1.
+ *                   The tables have period / binWidth entries (max. 4M).
+ *  @param harmonic  Harmonic of the repetition frequency to analyse,
+ *                   Range = 1 ... 16, default = 1.
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_setPhasorParams( Int32 period,
+                                        Int32 binWidth,
+                                        Int32 harmonic );
+
+
+/** Get Phasor Parameters
+ *
+ *  Retrieves the parameters set by @ref TDC_setPhasorParams.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param period    Output: Laser repetition period [ps]
+ *  @param binWidth  Output: Delay resolution [ps]
+ *  @param harmonic  Output: Analysed harmonic
+ *  @return          Error code
+ */
+TDC_API int TDC_CC TDC_getPhasorParams( Int32 * period,
+                                        Int32 * binWidth,
+                                        Int32 * harmonic );
+
+
+/** Set TDC Channel for Start Input
+ *
+ *  Sets the channel that receives the laser sync.
+ *  When the function is called, all collected data and the calibration
+ *  are cleared.
+ *  @param startChan  Start channel number, Range = 0 ... 32, default = 1.
+ *                    0 selects no start channel: the phase is taken from
+ *                    the timestamp modulo the period, i.e. the timestamps
+ *                    must be synchronous to the laser.
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_setPhasorStartInput( Int32 startChan );
+
+
+/** Get TDC Channel for Start Input
+ *
+ *  Retrieves the parameter set by @ref TDC_setPhasorStartInput.
+ *  @param startChan  Output: Start channel number
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_getPhasorStartInput( Int32 * startChan );
+
+
+/** Set Sync Divider
+ *
+ *  At high repetition rates, the start input of the device can be
+ *  divided (see @ref TDC_configureSyncDivider) so only every
+ *  divider-th laser pulse is transferred. Reconstructing the skipped
+ *  pulses in the device library costs much CPU time. Instead, disable
+ *  the reconstruction and set the same divider here: the pulse train is
+ *  then modelled by a period and a phase that follow the received start
+ *  events like a PLL, and the delays of the stop events are calculated
+ *  against the model. The model locks after two start events; stop
+ *  events before are ignored. Without a start channel, the divider
+ *  has no effect.
+ *  When the function is called, all collected data are cleared.
+ *  @param divider  Number of laser pulses per start event,
+ *                  Range = 1 ... 1024, default = 1 (no model).
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_setPhasorSyncDivider( Int32 divider );
+
+
+/** Get Sync Divider
+ *
+ *  Retrieves the parameter set by @ref TDC_setPhasorSyncDivider and the
+ *  state of the model.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param divider  Output: Number of laser pulses per start event
+ *  @param period   Output: Laser period estimated by the model [ps],
+ *                  0 if the model isn't locked or not in use.
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_getPhasorSyncDivider( Int32  * divider,
+                                             double * period );
+
+
+/** Add a Stop Channel
+ *
+ *  Adds or removes a channel whose events are accumulated as stop events.
+ *  Nothing will happen if an already existing channel is added and
+ *  vice versa. Adding or removing clears the data of the channel.
+ *  @param stopCh   Stop channel number, Range = 1 ... 32
+ *  @param add      Add (true) or remove (false) the channel
+ *  @return         Error code
+ */
+TDC_API int TDC_CC TDC_addPhasorChannel( Int32 stopCh,
+                                         Bln32 add );
+
+
+/** Calibrate Phasors
+ *
+ *  Calibrates the phasors with a reference sample of known lifetime,
+ *  usually measured on the same stop channel before. The current phasor
+ *  of the channel is rotated and scaled onto the universal circle point
+ *  of the reference lifetime; the correction applies to all channels.
+ *  @param channel      Stop channel with the reference measurement;
+ *                      ignored if refLifetime is 0.
+ *  @param refLifetime  Lifetime of the reference [ps]; 0 removes the
+ *                      calibration.
+ *  @return             Error code; @ref TDC_NotAvailable if there are no
+ *                      events on the channel.
+ */
+TDC_API int TDC_CC TDC_calibratePhasor( Int32  channel,
+                                        double refLifetime );
+
+
+/** Reset Phasors
+ *
+ *  Clears the accumulated sums of all channels.
+ *  @return  Error code
+ */
+TDC_API int TDC_CC TDC_resetPhasor( void );
+
+
+/** Process Timestamps
+ *
+ *  Feeds timestamps to the accumulator. The arrays have the format
+ *  delivered by @ref TDC_getLastTimestamps: timestamps in ps in increasing
+ *  order, channel numbers 0...31 for channels 1...32.
+ *  @param timestamps Input: Array of timestamps
+ *  @param channels   Input: Array of corresponding channel numbers
+ *  @param count      Number of valid elements in both arrays
+ *  @return           Error code
+ */
+TDC_API int TDC_CC TDC_addPhasorTimestamps( const Int64 * timestamps,
+                                            const Uint8 * channels,
+                                            Int32         count );
+
+
+/** Retrieve Phasor
+ *
+ *  Retrieves the calibrated phasor coordinates of a stop channel.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param channel  Stop channel number
+ *  @param g        Output: Phasor coordinate g (cosine part)
+ *  @param s        Output: Phasor coordinate s (sine part)
+ *  @param count    Output: Number of stop events contributing
+ *  @return         Error code; TDC_NotEnabled if the channel hasn't been added.
+ */
+TDC_API int TDC_CC TDC_getPhasor( Int32    channel,
+                                  double * g,
+                                  double * s,
+                                  Int64  * count );
+
+
+/** Retrieve Phasor Lifetimes
+ *
+ *  Calculates the lifetime estimates of a stop channel from its
+ *  calibrated phasor. Both agree for a single exponential decay.
+ *  All output parameters may be NULL to ignore the value.
+ *  @param channel   Stop channel number
+ *  @param tauPhase  Output: Phase lifetime s / (n w g) [ps]
+ *  @param tauMod    Output: Modulation lifetime
+ *                   sqrt( 1 / (g^2 + s^2) - 1 ) / (n w) [ps]
+ *  @return          Error code; TDC_NotAvailable if there are no events.
+ */
+TDC_API int TDC_CC TDC_getPhasorLifetime( Int32    channel,
+                                          double * tauPhase,
+                                          double * tauMod );
+
+#endif
@@ -0,0 +1,142 @@
+/*******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       benchdecode.c
+ *
+ *  Purpose:        Benchmark of the timestamp record decoders
+ *
+ *******************************************************************************/
+/* $Id$ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "tdcdecode.h"
+
+#ifdef unix
+#include <sys/time.h>
+#else
+#include <windows.h>
+#endif
+
+
+#define COUNT   (4 * 1024 * 1024)     /* Records per run */
+#define RUNS    20
+
+
+static double timestamp()
+{
+#ifdef unix
+  struct timeval tv;
+  gettimeofday( &tv, 0 );
+  return tv .tv_sec + tv .tv_usec / 1.e6;
+#else
+  return GetTickCount() / 1000.;
+#endif
+}
+
+
+/*
+ * Random records with increasing timestamps; the compressed ones
+ * overflow every few million records.
+ */
+static void generate( Uint8 * binary, Uint8 * compressed )
+{
+  Int64 t = 0;
+  Int32 i;
+  srand( 1 );
+  for ( i = 0; i < COUNT; ++i ) {
+    Uint8 * b = binary     + (size_t) i * TDC_BINARY_RECORD;
+    Uint8 * c = compressed + (size_t) i * TDC_COMPRESSED_RECORD;
+    Int64 v;
+    int   k, ch = rand() % 8;
+    t += rand() % 100000;
+    for ( k = 0; k < 8; ++k ) {
+      b[k] = (Uint8) (t >> (8 * k));
+    }
+    b[8] = (Uint8) ch;
+    b[9] = 0;
+    v = (t & ((1LL << 37) - 1)) | ((Int64) ch << 37);
+    for ( k = 0; k < 5; ++k ) {
+      c[k] = (Uint8) (v >> (8 * k));
+    }
+  }
+}
+
+
+static void bench( const char * name, TDC_DecodeImpl impl,
+                   const Uint8 * binary, const Uint8 * compressed,
+                   Int64 * ts, Uint8 * ch, const Int64 * refTs, const Uint8 * refCh )
+{
+  double t0, tBin, tComp;
+  Int64  last = 0;
+  int    run, ok = 1;
+
+  if ( TDC_setDecodeImpl( impl ) != TDC_Ok ) {
+    printf( "%-8s not available\n", name );
+    return;
+  }
+
+  t0 = timestamp();
+  for ( run = 0; run < RUNS; ++run ) {
+    TDC_decodeBinary( binary, COUNT, ts, ch );
+  }
+  tBin = (timestamp() - t0) / RUNS;
+  ok = !memcmp( ts, refTs, COUNT * sizeof( Int64 ) ) && !memcmp( ch, refCh, COUNT );
+
+  t0 = timestamp();
+  for ( run = 0; run < RUNS; ++run ) {
+    last = 0;
+    TDC_decodeCompressed( compressed, COUNT, ts, ch, &last );
+  }
+  tComp = (timestamp() - t0) / RUNS;
+  /* The steps are far below the overflow, so unwrapping restores them */
+  ok = ok && !memcmp( ts, refTs, COUNT * sizeof( Int64 ) ) && !memcmp( ch, refCh, COUNT );
+
+  printf( "%-8s binary %8.1f MEvents/s   compressed %8.1f MEvents/s   %s\n",
+          name, COUNT / tBin / 1.e6, COUNT / tComp / 1.e6, ok ? "ok" : "MISMATCH" );
+}
+
+
+int main()
+{
+  Uint8 * binary     = (Uint8 *) malloc( (size_t) COUNT * TDC_BINARY_RECORD );
+  Uint8 * compressed = (Uint8 *) malloc( (size_t) COUNT * TDC_COMPRESSED_RECORD );
+  Int64 * ts         = (Int64 *) malloc( COUNT * sizeof( Int64 ) );
+  Uint8 * ch         = (Uint8 *) malloc( COUNT );
+  Int64 * refTs      = (Int64 *) malloc( COUNT * sizeof( Int64 ) );
+  Uint8 * refCh      = (Uint8 *) malloc( COUNT );
+  TDC_DecodeImpl best;
+  Int32 i;
+
+  if ( !binary || !compressed || !ts || !ch || !refTs || !refCh ) {
+    printf( ">>> Out of memory\n" );
+    return 1;
+  }
+  generate( binary, compressed );
+  TDC_getDecodeImpl( &best );
+  printf( "Decoding %d records, %d runs; best implementation: %d\n", COUNT, RUNS, (int) best );
+
+  for ( i = 0; i < COUNT; ++i ) {           /* Reference: plain byte access */
+    const Uint8 * b = binary + (size_t) i * TDC_BINARY_RECORD;
+    int k;
+    refTs[i] = 0;
+    for ( k = 0; k < 8; ++k ) {
+      refTs[i] |= (Int64) b[k] << (8 * k);
+    }
+    refCh[i] = b[8];
+  }
+
+  bench( "scalar",  DECODE_SCALAR, binary, compressed, ts, ch, refTs, refCh );
+  bench( "AVX2",    DECODE_AVX2,   binary, compressed, ts, ch, refTs, refCh );
+  bench( "AVX-512", DECODE_AVX512, binary, compressed, ts, ch, refTs, refCh );
+
+  free( binary );
+  free( compressed );
+  free( ts );
+  free( ch );
+  free( refTs );
+  free( refCh );
+  return 0;
+}
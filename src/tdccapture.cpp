@@ -0,0 +1,262 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdccapture.cpp
+ *
+ *  Purpose:        Capture and replay of timestamp streams
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdccapture.h"
+#include "tdcbase.h"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+/* A capture file starts with a magic string, followed by records of a
+ * fixed head and, for timestamp blocks, the timestamps and channels of
+ * the block. Everything is stored in host byte order. The device data
+ * are retrieved outside the lock, so capturing several devices from
+ * several threads only serializes the file writes.
+ */
+
+#define MAGIC       "TDCCAPT1"
+#define MAGIC_SIZE  8
+#define MAX_BLOCK   1000000           /* Max. timestamp buffer size */
+
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+
+enum RecordType {
+  RECORD_TIMESTAMPS,
+  RECORD_LOST
+};
+
+struct RecordHead {
+  Int64 time;                         /* Since start of capture [us] */
+  Int32 type;
+  Int32 devNo;                        /* -1: global device */
+  Int32 count;
+  Int32 lost;
+};
+
+struct Capture {
+  std::mutex        lock;
+  FILE            * file   = 0;
+  bool              failed = false;   /* A write has failed */
+  Clock::time_point start;
+  Int64             blocks = 0;
+  Int64             events = 0;
+};
+
+Capture cp;
+
+}
+
+
+static Int32 deviceNo( TDC_Device * dev )
+{
+  unsigned int no = 0;
+  if ( !dev || TDC_getDeviceNo( dev, &no ) != TDC_Ok ) {
+    return -1;
+  }
+  return (Int32) no;
+}
+
+
+static void writeData( const void * data, size_t size )
+{
+  if ( size && fwrite( data, size, 1, cp.file ) != 1 ) {
+    cp.failed = true;
+  }
+}
+
+
+static void record( RecordType type, Int32 devNo, const Int64 * timestamps,
+                    const Uint8 * channels, Int32 count, Bln32 lost )
+{
+  std::lock_guard<std::mutex> guard( cp.lock );
+  if ( !cp.file ) {
+    return;
+  }
+  RecordHead head;
+  head.time  = std::chrono::duration_cast<std::chrono::microseconds>(
+                 Clock::now() - cp.start ).count();
+  head.type  = type;
+  head.devNo = devNo;
+  head.count = count;
+  head.lost  = lost;
+  writeData( &head, sizeof( head ) );
+  if ( type == RECORD_TIMESTAMPS ) {
+    writeData( timestamps, count * sizeof( Int64 ) );
+    writeData( channels, count );
+    cp.blocks++;
+    cp.events += count;
+  }
+}
+
+
+static int closeFile()
+{
+  bool failed = fclose( cp.file ) != 0 || cp.failed;
+  cp.file   = 0;
+  cp.failed = false;
+  return failed ? TDC_Error : TDC_Ok;
+}
+
+
+int TDC_CC TDC_startCapture( const char * filename )
+{
+  if ( !filename ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cp.lock );
+  if ( cp.file ) {
+    int rc = closeFile();
+    if ( rc != TDC_Ok ) {
+      return rc;
+    }
+  }
+  cp.file = fopen( filename, "wb" );
+  if ( !cp.file ) {
+    return TDC_CantOpen;
+  }
+  cp.start  = Clock::now();
+  cp.blocks = 0;
+  cp.events = 0;
+  writeData( MAGIC, MAGIC_SIZE );
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_stopCapture( Int64 * blocks,
+                            Int64 * events )
+{
+  std::lock_guard<std::mutex> guard( cp.lock );
+  if ( !cp.file ) {
+    return TDC_NotEnabled;
+  }
+  if ( blocks ) {
+    *blocks = cp.blocks;
+  }
+  if ( events ) {
+    *events = cp.events;
+  }
+  return closeFile();
+}
+
+
+int TDC_CC TDC_captureLastTimestamps( TDC_Device * dev,
+                                      Bln32        reset,
+                                      Int64      * timestamps,
+                                      Uint8      * channels,
+                                      Int32      * valid )
+{
+  if ( !timestamps || !channels || !valid ) {
+    return TDC_OutOfRange;
+  }
+  int rc = dev ? TDC_devGetLastTimestamps( dev, reset, timestamps, channels, valid )
+               : TDC_getLastTimestamps( reset, timestamps, channels, valid );
+  if ( rc == TDC_Ok ) {
+    record( RECORD_TIMESTAMPS, deviceNo( dev ), timestamps, channels, *valid, 0 );
+  }
+  return rc;
+}
+
+
+int TDC_CC TDC_captureDataLost( TDC_Device * dev,
+                                Bln32      * lost )
+{
+  if ( !lost ) {
+    return TDC_OutOfRange;
+  }
+  int rc = dev ? TDC_devGetDataLost( dev, lost ) : TDC_getDataLost( lost );
+  if ( rc == TDC_Ok ) {
+    record( RECORD_LOST, deviceNo( dev ), 0, 0, 0, *lost );
+  }
+  return rc;
+}
+
+
+int TDC_CC TDC_replayCapture( const char      * filename,
+                              TDC_ReplaySpeed   speed,
+                              Bln32             input,
+                              TDC_ReplayFct     fct,
+                              void            * user,
+                              Int64           * events )
+{
+  if ( !filename || (speed != REPLAY_ORIGINAL && speed != REPLAY_MAX) ) {
+    return TDC_OutOfRange;
+  }
+  FILE * f = fopen( filename, "rb" );
+  if ( !f ) {
+    return TDC_CantOpen;
+  }
+  char magic[MAGIC_SIZE];
+  if ( fread( magic, MAGIC_SIZE, 1, f ) != 1 || memcmp( magic, MAGIC, MAGIC_SIZE ) ) {
+    fclose( f );
+    return TDC_OutOfRange;
+  }
+
+  std::vector<Int64> timestamps;
+  std::vector<Uint8> channels;
+  Clock::time_point  start = Clock::now();
+  Int64              replayed = 0;
+  RecordHead         head;
+  int                rc = TDC_Ok;
+
+  for ( ;; ) {
+    size_t got = fread( &head, 1, sizeof( head ), f );
+    if ( got != sizeof( head ) ) {
+      if ( got || ferror( f ) ) {
+        rc = TDC_OutOfRange;          /* Truncated record */
+      }
+      break;
+    }
+    if ( (head.type != RECORD_TIMESTAMPS && head.type != RECORD_LOST) ||
+         head.count < 0 || head.count > MAX_BLOCK ) {
+      rc = TDC_OutOfRange;
+      break;
+    }
+    if ( head.type == RECORD_TIMESTAMPS ) {
+      timestamps.resize( head.count );
+      channels.resize( head.count );
+      if ( head.count &&
+           (fread( timestamps.data(), head.count * sizeof( Int64 ), 1, f ) != 1 ||
+            fread( channels.data(), head.count, 1, f ) != 1) ) {
+        rc = TDC_OutOfRange;
+        break;
+      }
+    }
+    if ( speed == REPLAY_ORIGINAL ) {
+      std::this_thread::sleep_until( start + std::chrono::microseconds( head.time ) );
+    }
+    if ( head.type == RECORD_LOST ) {
+      if ( fct ) {
+        fct( head.devNo, 0, 0, 0, head.lost, user );
+      }
+      continue;
+    }
+    if ( input && head.count ) {
+      rc = TDC_inputTimestamps( timestamps.data(), channels.data(), head.count );
+      if ( rc != TDC_Ok ) {
+        break;
+      }
+    }
+    if ( fct ) {
+      fct( head.devNo, timestamps.data(), channels.data(), head.count, 0, user );
+    }
+    replayed += head.count;
+  }
+  fclose( f );
+  if ( events ) {
+    *events = replayed;
+  }
+  return rc;
+}
@@ -0,0 +1,670 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdccoinc.cpp
+ *
+ *  Purpose:        Coincidence counters for arbitrary channel groups
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdccoinc.h"
+#include "tdcwindow.h"
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+/* Every stream keeps the time of the latest event per channel. An
+ * event completes a coincidence of a group containing its channel if
+ * the latest events of all other channels of the group lie within the
+ * window of the group before it. The groups are looked up per channel,
+ * so channels in no group cost nothing but the singles counter.
+ *
+ * The delayed events wait in one queue per channel. Since the input is
+ * sorted, no event later than the newest input time plus the smallest
+ * delay (the watermark) can come anymore; the queues are merged up to
+ * there with a heap of the queue heads.
+ *
+ * Accidentals are counted on a second stream where channel k is shifted
+ * by k times the accidentals delay in addition to its own delay. The
+ * shifts differ between any two channels, so true coincidences are
+ * destroyed while the rates are preserved.
+ */
+
+#define CHANNELS   32
+#define MAX_DELAY  1000000000
+
+namespace {
+
+struct Group {
+  unsigned    mask;                   /* Channel mask */
+  Int32       coincWin;               /* -1: default window */
+};
+
+struct Head {
+  Int64       time;
+  int         ch;
+  bool operator<( const Head & h ) const { return time > h.time; }   /* Min heap */
+};
+
+struct Stream {                       /* Delayed merge and latest events */
+  Int64       delay[CHANNELS];
+  Int64       minDelay  = 0;
+  EventWindow queue[CHANNELS];
+  std::vector<Head> heads;
+  unsigned    seen      = 0;          /* Channels with an event */
+  Int64       latest[CHANNELS];       /* Latest event per channel */
+
+  Stream()
+  {
+    std::fill( delay, delay + CHANNELS, 0 );
+  }
+};
+
+struct Exposure {
+  Int32              singles[CHANNELS];
+  std::vector<Int32> coinc;
+  std::vector<Int32> accid;           /* Delayed window coincidences */
+};
+
+struct History {                      /* Ring of complete exposures */
+  Int32              size    = 64;
+  Int32              next    = 0;     /* Slot to be written next */
+  Int32              unread  = 0;
+  Int32              lost    = 0;     /* Overwritten before read */
+  std::vector<Int64> time;            /* Exposure start times */
+  std::vector<char>  empty;
+  std::vector<Int32> singles;         /* size * CHANNELS */
+  std::vector<Int32> coinc;           /* size * groups */
+};
+
+struct CoincGroups {
+  std::mutex  lock;
+  bool        enabled   = false;
+  Int32       coincWin  = 1000;
+  Int32       expTime   = 1000;
+  std::vector<Group> groups;
+  std::vector<Int32> chGroups[CHANNELS];  /* Groups containing a channel */
+  Int32       delay[CHANNELS];
+  Int32       accDelay  = 0;          /* Accidentals shift, 0 = off */
+  Stream      main;
+  Stream      accid;
+  Exposure    current;                /* Exposure being accumulated */
+  Exposure    last;                   /* Last complete exposure */
+  History     history;
+  Int64       expIndex  = -1;         /* Index of the current exposure */
+  Int32       updates   = 0;
+
+  CoincGroups()
+  {
+    std::fill( delay, delay + CHANNELS, 0 );
+  }
+};
+
+CoincGroups cg;
+
+}
+
+
+static void clearExposure( Exposure & exp )
+{
+  std::fill( exp.singles, exp.singles + CHANNELS, 0 );
+  exp.coinc.assign( cg.groups.size(), 0 );
+  exp.accid.assign( cg.groups.size(), 0 );
+}
+
+
+static void clearHistory()
+{
+  History & h = cg.history;
+  h.next = h.unread = h.lost = 0;
+  h.time.assign( h.size, 0 );
+  h.empty.assign( h.size, 1 );
+  h.singles.assign( (size_t) h.size * CHANNELS, 0 );
+  h.coinc.assign( (size_t) h.size * cg.groups.size(), 0 );
+}
+
+
+/* Appends a complete exposure to the history; exp = 0 for an empty one */
+static void pushHistory( Int64 index, const Exposure * exp )
+{
+  History & h    = cg.history;
+  const size_t n = cg.groups.size();
+  const Int32  s = h.next;
+  if ( h.unread == h.size ) {
+    h.lost += !h.empty[s];
+  }
+  else {
+    h.unread++;
+  }
+  h.time[s]  = index * cg.expTime * 1000000000;
+  h.empty[s] = !exp;
+  Int32 * singles = h.singles.data() + (size_t) s * CHANNELS;
+  Int32 * coinc   = h.coinc.data() + s * n;
+  if ( exp ) {
+    std::copy( exp ->singles, exp ->singles + CHANNELS, singles );
+    std::copy( exp ->coinc.begin(), exp ->coinc.end(), coinc );
+  }
+  else {
+    std::fill( singles, singles + CHANNELS, 0 );
+    std::fill( coinc, coinc + n, 0 );
+  }
+  h.next = (s + 1) % h.size;
+}
+
+
+static void clearStream( Stream & st )
+{
+  st.seen = 0;
+  st.heads.clear();
+  for ( int i = 0; i < CHANNELS; ++i ) {
+    st.queue[i] = EventWindow();
+  }
+}
+
+
+static void clearData()
+{
+  clearHistory();
+  clearExposure( cg.current );
+  clearExposure( cg.last );
+  cg.expIndex = -1;
+  cg.updates  = 0;
+  clearStream( cg.main );
+  clearStream( cg.accid );
+}
+
+
+static int bitCount( unsigned mask )
+{
+  int n = 0;
+  for ( ; mask; mask &= mask - 1 ) {
+    ++n;
+  }
+  return n;
+}
+
+
+static Int32 groupWindow( const Group & g )
+{
+  return g.coincWin < 0 ? cg.coincWin : g.coincWin;
+}
+
+
+static void updateGroups()
+{
+  for ( int ch = 0; ch < CHANNELS; ++ch ) {
+    cg.chGroups[ch].clear();
+    for ( size_t i = 0; i < cg.groups.size(); ++i ) {
+      if ( cg.groups[i].mask & (1u << ch) ) {
+        cg.chGroups[ch].push_back( (Int32) i );
+      }
+    }
+  }
+}
+
+
+static void updateDelays()
+{
+  for ( int i = 0; i < CHANNELS; ++i ) {
+    cg.main.delay[i]  = cg.delay[i];
+    cg.accid.delay[i] = cg.delay[i] + (Int64) i * cg.accDelay;
+  }
+  cg.main.minDelay  = *std::min_element( cg.main.delay, cg.main.delay + CHANNELS );
+  cg.accid.minDelay = *std::min_element( cg.accid.delay, cg.accid.delay + CHANNELS );
+}
+
+
+/* Checks if the latest events of the channels lie within the window
+ * before an event at time
+ */
+static bool within( const Stream & st, unsigned mask, Int64 time, Int32 coincWin )
+{
+  if ( (st.seen & mask) != mask ) {
+    return false;
+  }
+  for ( int ch = 0; mask; ++ch, mask >>= 1 ) {
+    if ( (mask & 1) && time - st.latest[ch] > coincWin ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+/* Records an event and counts the groups it completes */
+static void addEvent( Stream & st, int ch, Int64 time, std::vector<Int32> & coinc )
+{
+  st.seen      |= 1u << ch;
+  st.latest[ch] = time;
+  for ( Int32 i : cg.chGroups[ch] ) {
+    const Group & g = cg.groups[i];
+    if ( within( st, g.mask, time, groupWindow( g ) ) ) {
+      coinc[i]++;
+    }
+  }
+}
+
+
+static void processEvent( int ch, Int64 time )
+{
+  const Int64 expPs = (Int64) cg.expTime * 1000000000;
+  Int64 index = time > 0 ? time / expPs : 0;
+  if ( index > cg.expIndex ) {
+    if ( cg.expIndex >= 0 ) {
+      pushHistory( cg.expIndex, &cg.current );
+      std::swap( cg.last, cg.current );
+      clearExposure( cg.current );
+      if ( index - cg.expIndex > 1 ) {
+        clearExposure( cg.last );           /* Skipped exposures are empty */
+      }
+      Int64 skipped = std::min<Int64>( index - cg.expIndex - 1, cg.history.size );
+      for ( Int64 k = index - skipped; k < index; ++k ) {
+        pushHistory( k, 0 );
+      }
+      cg.updates += (Int32) std::min<Int64>( index - cg.expIndex, 0x7fffffff - cg.updates );
+    }
+    cg.expIndex = index;
+  }
+  addEvent( cg.main, ch, time, cg.current.coinc );
+  cg.current.singles[ch]++;
+}
+
+
+/* Accidentals are counted in the exposure that is current in the main
+ * stream when they are completed.
+ */
+static void processAccidental( int ch, Int64 time )
+{
+  addEvent( cg.accid, ch, time, cg.current.accid );
+}
+
+
+static void enqueue( Stream & st, int ch, Int64 time )
+{
+  time += st.delay[ch];
+  if ( !st.queue[ch].size() ) {
+    st.heads.push_back( { time, ch } );
+    std::push_heap( st.heads.begin(), st.heads.end() );
+  }
+  st.queue[ch].push( time );
+}
+
+
+/* Removes the earliest event from the queues */
+static Head pop( Stream & st )
+{
+  std::pop_heap( st.heads.begin(), st.heads.end() );
+  Head h = st.heads.back();
+  st.heads.pop_back();
+  EventWindow & q = st.queue[h.ch];
+  q.popFront();
+  if ( q.size() ) {
+    st.heads.push_back( { q.at( 0 ), h.ch } );
+    std::push_heap( st.heads.begin(), st.heads.end() );
+  }
+  return h;
+}
+
+
+static void processEvents( const Int64 * timestamps, const Uint8 * channels, Int32 count )
+{
+  const bool accid = cg.accDelay > 0;
+  Int64 newest = 0;
+  bool  any    = false;
+  for ( Int32 i = 0; i < count; ++i ) {
+    int ch = channels[i];
+    if ( ch >= CHANNELS ) {
+      continue;
+    }
+    enqueue( cg.main, ch, timestamps[i] );
+    if ( accid ) {
+      enqueue( cg.accid, ch, timestamps[i] );
+    }
+    newest = timestamps[i];
+    any    = true;
+  }
+  if ( !any ) {
+    return;
+  }
+
+  /* Both streams are merged up to their watermarks in common time order,
+   * so the accidentals fall into the current exposure of the main stream.
+   */
+  const Int64 markMain  = newest + cg.main.minDelay;
+  const Int64 markAccid = newest + cg.accid.minDelay;
+  for ( ;; ) {
+    bool m = !cg.main.heads.empty() && cg.main.heads.front().time <= markMain;
+    bool a = accid && !cg.accid.heads.empty() && cg.accid.heads.front().time <= markAccid;
+    if ( m && (!a || cg.main.heads.front().time <= cg.accid.heads.front().time) ) {
+      Head h = pop( cg.main );
+      processEvent( h.ch, h.time );
+    }
+    else if ( a ) {
+      Head h = pop( cg.accid );
+      processAccidental( h.ch, h.time );
+    }
+    else {
+      break;
+    }
+  }
+}
+
+
+int TDC_CC TDC_enableCoincGroups( Bln32 enable )
+{
+  std::lock_guard<std::mutex> guard( cg.lock );
+  cg.enabled = enable != 0;
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setCoincGroupParams( Int32 coincWin,
+                                    Int32 expTime )
+{
+  if ( coincWin < 0 || coincWin > 2000000000 || expTime < 1 || expTime > 65535 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  cg.coincWin = coincWin;
+  cg.expTime  = expTime;
+  updateGroups();
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getCoincGroupParams( Int32 * coincWin,
+                                    Int32 * expTime )
+{
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( coincWin ) {
+    *coincWin = cg.coincWin;
+  }
+  if ( expTime ) {
+    *expTime = cg.expTime;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addCoincGroup( Int32   chMask,
+                              Int32 * group )
+{
+  if ( !chMask ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( cg.groups.size() >= TDC_COINC_GROUPS ) {
+    return TDC_OutOfRange;
+  }
+  cg.groups.push_back( { (unsigned) chMask, -1 } );
+  updateGroups();
+  clearData();
+  if ( group ) {
+    *group = (Int32) cg.groups.size() - 1;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setCoincGroupWindow( Int32 group,
+                                    Int32 coincWin )
+{
+  if ( coincWin < -1 || coincWin > 2000000000 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( group < 0 || group >= (Int32) cg.groups.size() ) {
+    return TDC_OutOfRange;
+  }
+  cg.groups[group].coincWin = coincWin;
+  updateGroups();
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getCoincGroupWindow( Int32   group,
+                                    Int32 * coincWin )
+{
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( group < 0 || group >= (Int32) cg.groups.size() ) {
+    return TDC_OutOfRange;
+  }
+  if ( coincWin ) {
+    *coincWin = groupWindow( cg.groups[group] );
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setCoincGroupDelay( Int32 channel,
+                                   Int32 delay )
+{
+  if ( channel < 1 || channel > CHANNELS || delay < -MAX_DELAY || delay > MAX_DELAY ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  cg.delay[channel - 1] = delay;
+  updateDelays();
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getCoincGroupDelay( Int32   channel,
+                                   Int32 * delay )
+{
+  if ( channel < 1 || channel > CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( delay ) {
+    *delay = cg.delay[channel - 1];
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_clearCoincGroups( void )
+{
+  std::lock_guard<std::mutex> guard( cg.lock );
+  cg.groups.clear();
+  updateGroups();
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_resetCoincGroups( void )
+{
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( !cg.enabled ) {
+    return TDC_NotEnabled;
+  }
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addCoincGroupTimestamps( const Int64 * timestamps,
+                                        const Uint8 * channels,
+                                        Int32         count )
+{
+  if ( count < 0 || (count && (!timestamps || !channels)) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( !cg.enabled ) {
+    return TDC_NotEnabled;
+  }
+  processEvents( timestamps, channels, count );
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getCoincGroupCounters( Int32 * singles,
+                                      Int32 * coinc,
+                                      Int32 * coincSize,
+                                      Int32 * updates )
+{
+  if ( coinc && !coincSize ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( !cg.enabled ) {
+    return TDC_NotEnabled;
+  }
+  Int32 n = (Int32) cg.groups.size();
+  if ( coinc && *coincSize < n ) {
+    *coincSize = n;
+    return TDC_OutOfRange;
+  }
+  if ( singles ) {
+    std::copy( cg.last.singles, cg.last.singles + CHANNELS, singles );
+  }
+  if ( coinc ) {
+    std::copy( cg.last.coinc.begin(), cg.last.coinc.end(), coinc );
+  }
+  if ( coincSize ) {
+    *coincSize = n;
+  }
+  if ( updates ) {
+    *updates   = cg.updates;
+    cg.updates = 0;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setCoincGroupHistory( Int32 size )
+{
+  if ( size < 1 || size > 65536 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  cg.history.size = size;
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getCoincGroupHistory( Int32 * size )
+{
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( size ) {
+    *size = cg.history.size;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_drainCoincGroupCounters( Int64 * times,
+                                        Int32 * singles,
+                                        Int32 * coinc,
+                                        Int32 * count,
+                                        Int32 * lost )
+{
+  if ( !count || *count < 0 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( !cg.enabled ) {
+    return TDC_NotEnabled;
+  }
+  History &    h = cg.history;
+  const size_t n = cg.groups.size();
+  Int32 drain = std::min( *count, h.unread );
+  Int32 first = (h.next - h.unread + h.size) % h.size;
+  for ( Int32 i = 0; i < drain; ++i ) {
+    Int32 s = (first + i) % h.size;
+    if ( times ) {
+      times[i] = h.time[s];
+    }
+    if ( singles ) {
+      const Int32 * src = h.singles.data() + (size_t) s * CHANNELS;
+      std::copy( src, src + CHANNELS, singles + (size_t) i * CHANNELS );
+    }
+    if ( coinc ) {
+      const Int32 * src = h.coinc.data() + s * n;
+      std::copy( src, src + n, coinc + i * n );
+    }
+  }
+  h.unread -= drain;
+  *count = drain;
+  if ( lost ) {
+    *lost  = h.lost;
+    h.lost = 0;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setCoincGroupAccidentals( Int32 delay )
+{
+  if ( delay < 0 || delay > MAX_DELAY / CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  cg.accDelay = delay;
+  updateDelays();
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getCoincGroupAccidentals( Int32 * delayed,
+                                         double * analytic,
+                                         double * corrected,
+                                         Int32  * coincSize )
+{
+  if ( (delayed || analytic || corrected) && !coincSize ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cg.lock );
+  if ( !cg.enabled ) {
+    return TDC_NotEnabled;
+  }
+  Int32 n = (Int32) cg.groups.size();
+  if ( (delayed || analytic || corrected) && *coincSize < n ) {
+    *coincSize = n;
+    return TDC_OutOfRange;
+  }
+  if ( coincSize ) {
+    *coincSize = n;
+  }
+
+  /* n-fold accidentals within a window w: n w^(n-1) R1 ... Rn per second */
+  const double expSec = cg.expTime * 1e-3;
+  for ( Int32 i = 0; i < n; ++i ) {
+    const Group & g = cg.groups[i];
+    double acc  = 0.;
+    int    mult = bitCount( g.mask );
+    if ( mult > 1 ) {
+      double win = groupWindow( g ) * 1e-12;
+      acc = mult * expSec;
+      for ( int k = 0; k < mult - 1; ++k ) {
+        acc *= win;
+      }
+      for ( int ch = 0; ch < CHANNELS; ++ch ) {
+        if ( g.mask & (1u << ch) ) {
+          acc *= cg.last.singles[ch] / expSec;
+        }
+      }
+    }
+    if ( delayed ) {
+      delayed[i] = cg.last.accid[i];
+    }
+    if ( analytic ) {
+      analytic[i] = acc;
+    }
+    if ( corrected ) {
+      corrected[i] = cg.last.coinc[i] - (cg.accDelay > 0 ? (double) cg.last.accid[i] : acc);
+    }
+  }
+  return TDC_Ok;
+}
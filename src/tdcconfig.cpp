@@ -0,0 +1,341 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcconfig.cpp
+ *
+ *  Purpose:        Device configuration profiles
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdcconfig.h"
+#include "tdcdevhandle.h"
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+
+/* The configuration of a device is cached in its handle; setting
+ * functions of tdcdevice.h invalidate the cache. Applying compares with
+ * the cached state, reading it back first if necessary. The readback
+ * of thresholds is quantized by the DAC, so thresholds are only resent
+ * if they differ by more than half a DAC step. The profile file is plain
+ * text, "<key> [<channel>] <value>..." per line, '#' starts a comment.
+ */
+
+#define THRESHOLD_RES  0.00147        /* Threshold resolution [V] */
+#define LINE_LEN       256
+
+
+/* Reads the configuration of the addressed device */
+static int readConfig( const TDC_Device * dev, TDC_DeviceConfig * cfg )
+{
+  *cfg = TDC_DeviceConfig();
+  cfg ->channels = dev ->channels < TDC_CONFIG_CHANNELS ? dev ->channels : TDC_CONFIG_CHANNELS;
+
+  int rc = TDC_getChannelsEnabled( &cfg ->enStart, &cfg ->channelMask );
+  if ( rc == TDC_Ok ) {
+    rc = TDC_getMarkersEnabled( &cfg ->markerMask );
+  }
+  if ( rc == TDC_Ok ) {
+    rc = TDC_getDeviceParams( &cfg ->coincWin, &cfg ->expTime );
+  }
+  if ( rc == TDC_Ok ) {
+    rc = TDC_getTimestampBufferSize( &cfg ->bufferSize );
+  }
+  for ( Int32 ch = 0; rc == TDC_Ok && ch < cfg ->channels; ++ch ) {
+    rc = TDC_getSignalConditioning( ch, &cfg ->edge[ch], &cfg ->threshold[ch] );
+    if ( rc == TDC_Ok ) {
+      rc = TDC_getChannelDelay( ch, &cfg ->delay[ch] );
+    }
+  }
+  if ( rc != TDC_Ok ) {
+    return rc;
+  }
+
+  /* Not available for all devices */
+  if ( TDC_getSyncDivider( &cfg ->syncDivider, &cfg ->syncReconstruct ) != TDC_Ok ) {
+    cfg ->syncDivider     = 0;
+    cfg ->syncReconstruct = 0;
+  }
+  for ( Int32 i = 0; i < TDC_CONFIG_FILTERS; ++i ) {
+    if ( i + 1 >= cfg ->channels ||
+         TDC_getFilter( i + 1, &cfg ->filterType[i], &cfg ->filterMask[i] ) != TDC_Ok ) {
+      cfg ->filterType[i] = FILTER_INVALID;
+      cfg ->filterMask[i] = 0;
+    }
+  }
+  return TDC_Ok;
+}
+
+
+/* Sends the differences between cfg and cur to the addressed device;
+ * cur is updated with the parameters sent.
+ */
+static int applyConfig( const TDC_DeviceConfig * cfg,
+                        TDC_DeviceConfig       & cur,
+                        Int32                  * sent )
+{
+  int   rc = TDC_Ok;
+  Int32 n  = 0;
+  auto update = [&]( bool changed, auto fct ) {
+    if ( rc == TDC_Ok && changed ) {
+      rc = fct();
+      ++n;
+    }
+  };
+
+  update( cfg ->enStart != cur.enStart || cfg ->channelMask != cur.channelMask,
+          [&]() { cur.enStart     = cfg ->enStart;
+                  cur.channelMask = cfg ->channelMask;
+                  return TDC_enableChannels( cfg ->enStart, cfg ->channelMask ); } );
+  update( cfg ->markerMask != cur.markerMask,
+          [&]() { cur.markerMask = cfg ->markerMask;
+                  return TDC_enableMarkers( cfg ->markerMask ); } );
+  for ( Int32 ch = 0; ch < cur.channels; ++ch ) {
+    update( cfg ->edge[ch] != cur.edge[ch] ||
+            fabs( cfg ->threshold[ch] - cur.threshold[ch] ) > THRESHOLD_RES / 2,
+            [&]() { cur.edge[ch]      = cfg ->edge[ch];
+                    cur.threshold[ch] = cfg ->threshold[ch];
+                    return TDC_configureSignalConditioning( ch, SCOND_MISC, cfg ->edge[ch],
+                                                            cfg ->threshold[ch] ); } );
+    update( cfg ->delay[ch] != cur.delay[ch],
+            [&]() { cur.delay[ch] = cfg ->delay[ch];
+                    return TDC_setChannelDelay( ch, cfg ->delay[ch] ); } );
+  }
+  for ( Int32 i = 0; i < TDC_CONFIG_FILTERS; ++i ) {
+    update( cfg ->filterType[i] != FILTER_INVALID && cur.filterType[i] != FILTER_INVALID &&
+            (cfg ->filterType[i] != cur.filterType[i] || cfg ->filterMask[i] != cur.filterMask[i]),
+            [&]() { cur.filterType[i] = cfg ->filterType[i];
+                    cur.filterMask[i] = cfg ->filterMask[i];
+                    return TDC_configureFilter( i + 1, cfg ->filterType[i], cfg ->filterMask[i] ); } );
+  }
+  update( cfg ->syncDivider && cur.syncDivider &&
+          (cfg ->syncDivider != cur.syncDivider || cfg ->syncReconstruct != cur.syncReconstruct),
+          [&]() { cur.syncDivider     = cfg ->syncDivider;
+                  cur.syncReconstruct = cfg ->syncReconstruct;
+                  return TDC_configureSyncDivider( cfg ->syncDivider, cfg ->syncReconstruct ); } );
+  update( cfg ->coincWin != cur.coincWin,
+          [&]() { cur.coincWin = cfg ->coincWin;
+                  return TDC_setCoincidenceWindow( cfg ->coincWin ); } );
+  update( cfg ->expTime != cur.expTime,
+          [&]() { cur.expTime = cfg ->expTime;
+                  return TDC_setExposureTime( cfg ->expTime ); } );
+  update( cfg ->bufferSize != cur.bufferSize,
+          [&]() { cur.bufferSize = cfg ->bufferSize;
+                  return TDC_setTimestampBufferSize( cfg ->bufferSize ); } );
+
+  if ( sent ) {
+    *sent = n;
+  }
+  return rc;
+}
+
+
+int TDC_CC TDC_devReadConfig( TDC_Device       * dev,
+                              TDC_DeviceConfig * config )
+{
+  if ( !dev ) {
+    return TDC_NoDevice;
+  }
+  if ( !config ) {
+    return TDC_OutOfRange;
+  }
+  DeviceScope scope( dev );
+  if ( scope.error() != TDC_Ok ) {
+    return scope.error();
+  }
+  int rc = readConfig( dev, &dev ->config );
+  dev ->configValid = rc == TDC_Ok;
+  if ( rc == TDC_Ok ) {
+    *config = dev ->config;
+  }
+  return rc;
+}
+
+
+int TDC_CC TDC_devGetConfig( TDC_Device       * dev,
+                             TDC_DeviceConfig * config )
+{
+  if ( !dev ) {
+    return TDC_NoDevice;
+  }
+  if ( !config ) {
+    return TDC_OutOfRange;
+  }
+  DeviceScope scope( dev, false );
+  if ( !dev ->configValid ) {
+    if ( scope.address() != TDC_Ok ) {
+      return scope.error();
+    }
+    int rc = readConfig( dev, &dev ->config );
+    if ( rc != TDC_Ok ) {
+      return rc;
+    }
+    dev ->configValid = true;
+  }
+  *config = dev ->config;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_devApplyConfig( TDC_Device             * dev,
+                               const TDC_DeviceConfig * config,
+                               Int32                  * sent )
+{
+  if ( sent ) {
+    *sent = 0;
+  }
+  if ( !dev ) {
+    return TDC_NoDevice;
+  }
+  if ( !config ) {
+    return TDC_OutOfRange;
+  }
+  DeviceScope scope( dev );
+  if ( scope.error() != TDC_Ok ) {
+    return scope.error();
+  }
+  int rc = TDC_Ok;
+  if ( !dev ->configValid ) {
+    rc = readConfig( dev, &dev ->config );
+  }
+  if ( rc == TDC_Ok ) {
+    rc = applyConfig( config, dev ->config, sent );
+  }
+  dev ->configValid = rc == TDC_Ok;
+  return rc;
+}
+
+
+int TDC_CC TDC_saveConfig( const char             * filename,
+                           const TDC_DeviceConfig * config )
+{
+  if ( !filename || !config ) {
+    return TDC_OutOfRange;
+  }
+  FILE * f = fopen( filename, "w" );
+  if ( !f ) {
+    return TDC_CantOpen;
+  }
+  Int32 channels = config ->channels < TDC_CONFIG_CHANNELS ? config ->channels : TDC_CONFIG_CHANNELS;
+  fprintf( f, "# TDC device configuration\n" );
+  fprintf( f, "channels %d\n",        channels );
+  fprintf( f, "enStart %d\n",         config ->enStart );
+  fprintf( f, "channelMask %d\n",     config ->channelMask );
+  fprintf( f, "markerMask %d\n",      config ->markerMask );
+  fprintf( f, "coincWin %d\n",        config ->coincWin );
+  fprintf( f, "expTime %d\n",         config ->expTime );
+  fprintf( f, "bufferSize %d\n",      config ->bufferSize );
+  fprintf( f, "syncDivider %d\n",     config ->syncDivider );
+  fprintf( f, "syncReconstruct %d\n", config ->syncReconstruct );
+  for ( Int32 ch = 0; ch < channels; ++ch ) {
+    fprintf( f, "edge %d %d\n",        ch, config ->edge[ch] );
+    fprintf( f, "threshold %d %.5f\n", ch, config ->threshold[ch] );
+    fprintf( f, "delay %d %d\n",       ch, config ->delay[ch] );
+  }
+  for ( Int32 i = 0; i < TDC_CONFIG_FILTERS; ++i ) {
+    if ( config ->filterType[i] != FILTER_INVALID ) {
+      fprintf( f, "filter %d %d %d\n", i + 1, (int) config ->filterType[i], config ->filterMask[i] );
+    }
+  }
+  int rc = ferror( f ) ? TDC_Error : TDC_Ok;
+  if ( fclose( f ) != 0 ) {
+    rc = TDC_Error;
+  }
+  return rc;
+}
+
+
+/* Parses one line into cfg; returns false if invalid */
+static bool parseLine( const char * line, TDC_DeviceConfig * cfg )
+{
+  static const struct {
+    const char * key;
+    size_t       offset;
+  } scalars[] = {
+    { "channels",        offsetof( TDC_DeviceConfig, channels )        },
+    { "enStart",         offsetof( TDC_DeviceConfig, enStart )         },
+    { "channelMask",     offsetof( TDC_DeviceConfig, channelMask )     },
+    { "markerMask",      offsetof( TDC_DeviceConfig, markerMask )      },
+    { "coincWin",        offsetof( TDC_DeviceConfig, coincWin )        },
+    { "expTime",         offsetof( TDC_DeviceConfig, expTime )         },
+    { "bufferSize",      offsetof( TDC_DeviceConfig, bufferSize )      },
+    { "syncDivider",     offsetof( TDC_DeviceConfig, syncDivider )     },
+    { "syncReconstruct", offsetof( TDC_DeviceConfig, syncReconstruct ) }
+  };
+
+  char  key[32];
+  int   len = 0, ch, i1, i2;
+  double d;
+  if ( sscanf( line, " %31s%n", key, &len ) != 1 || key[0] == '#' ) {
+    return true;                       /* Empty line or comment */
+  }
+  const char * args = line + len;
+
+  for ( const auto & s : scalars ) {
+    if ( !strcmp( key, s.key ) ) {
+      if ( sscanf( args, "%d", &i1 ) != 1 ) {
+        return false;
+      }
+      if ( strcmp( key, "channels" ) ) {  /* Read only */
+        *(Int32 *) ((char *) cfg + s.offset) = i1;
+      }
+      return true;
+    }
+  }
+  if ( !strcmp( key, "edge" ) || !strcmp( key, "delay" ) ) {
+    if ( sscanf( args, "%d %d", &ch, &i1 ) != 2 || ch < 0 || ch >= TDC_CONFIG_CHANNELS ) {
+      return false;
+    }
+    ( key[0] == 'e' ? cfg ->edge : cfg ->delay )[ch] = i1;
+    return true;
+  }
+  if ( !strcmp( key, "threshold" ) ) {
+    if ( sscanf( args, "%d %lf", &ch, &d ) != 2 || ch < 0 || ch >= TDC_CONFIG_CHANNELS ) {
+      return false;
+    }
+    cfg ->threshold[ch] = d;
+    return true;
+  }
+  if ( !strcmp( key, "filter" ) ) {
+    if ( sscanf( args, "%d %d %d", &ch, &i1, &i2 ) != 3 || ch < 1 || ch > TDC_CONFIG_FILTERS ||
+         i1 < FILTER_NONE || i1 >= FILTER_INVALID ) {
+      return false;
+    }
+    cfg ->filterType[ch - 1] = (TDC_FilterType) i1;
+    cfg ->filterMask[ch - 1] = i2;
+    return true;
+  }
+  return false;
+}
+
+
+int TDC_CC TDC_loadConfig( const char       * filename,
+                           TDC_DeviceConfig * config )
+{
+  if ( !filename || !config ) {
+    return TDC_OutOfRange;
+  }
+  FILE * f = fopen( filename, "r" );
+  if ( !f ) {
+    return TDC_CantOpen;
+  }
+  TDC_DeviceConfig cfg = *config;
+  char line[LINE_LEN];
+  int  rc = TDC_Ok;
+  while ( rc == TDC_Ok && fgets( line, sizeof( line ), f ) ) {
+    if ( !parseLine( line, &cfg ) ) {
+      rc = TDC_OutOfRange;
+    }
+  }
+  if ( rc == TDC_Ok && ferror( f ) ) {
+    rc = TDC_Error;
+  }
+  fclose( f );
+  if ( rc == TDC_Ok ) {
+    *config = cfg;
+  }
+  return rc;
+}
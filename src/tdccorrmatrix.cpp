@@ -0,0 +1,339 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdccorrmatrix.cpp
+ *
+ *  Purpose:        Correlation functions for arbitrary channel pairs
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdccorrmatrix.h"
+#include "tdcwindow.h"
+#include <mutex>
+#include <vector>
+#include <cstdlib>
+
+/* A pair is stored once with channels lo <= hi. Its histogram holds
+ * binCount bins for t(hi) - t(lo) >= 0 ("forward") followed by binCount
+ * bins for t(hi) - t(lo) <= 0 ("backward"). Every event is compared
+ * with the windows of its partner channels only.
+ */
+
+#define CHANNELS   32
+#define NO_PAIR    (-1)
+
+namespace {
+
+struct CorrMatrix {
+  std::mutex  lock;
+  bool        enabled  = false;
+  Int32       binWidth = 100;
+  Int32       binCount = 256;
+  Int32       pairIdx[CHANNELS][CHANNELS];   /* [lo][hi] -> index in hist */
+  unsigned    partners[CHANNELS];            /* Bitmask of partner channels */
+  std::vector< std::vector<Int64> > hist;
+  EventWindow window[CHANNELS];
+  Int64       count[CHANNELS];
+  Int64       first    = 0;
+  Int64       last     = 0;
+  bool        started  = false;
+
+  CorrMatrix()
+  {
+    for ( int i = 0; i < CHANNELS; ++i ) {
+      partners[i] = 0;
+      count[i]    = 0;
+      for ( int j = 0; j < CHANNELS; ++j ) {
+        pairIdx[i][j] = NO_PAIR;
+      }
+    }
+  }
+};
+
+CorrMatrix cm;
+
+}
+
+
+static void clearData()
+{
+  for ( auto & h : cm.hist ) {
+    h.assign( 2 * (size_t) cm.binCount, 0 );
+  }
+  for ( int i = 0; i < CHANNELS; ++i ) {
+    cm.window[i].clear();
+    cm.count[i] = 0;
+  }
+  cm.first = cm.last = 0;
+  cm.started = false;
+}
+
+
+static void releaseData()
+{
+  for ( auto & h : cm.hist ) {
+    std::vector<Int64>().swap( h );
+  }
+  for ( int i = 0; i < CHANNELS; ++i ) {
+    cm.window[i] = EventWindow();
+    cm.count[i]  = 0;
+  }
+  cm.started = false;
+}
+
+
+static void processEvent( int ch, Int64 time )
+{
+  const Int64 range = (Int64) cm.binWidth * cm.binCount;
+  unsigned partners = cm.partners[ch];
+
+  if ( !cm.started ) {
+    cm.first   = time;
+    cm.started = true;
+  }
+  if ( time > cm.last ) {
+    cm.last = time;
+  }
+  cm.count[ch]++;
+  if ( !partners ) {
+    return;
+  }
+
+  for ( int d = 0; partners; ++d, partners >>= 1 ) {
+    if ( !(partners & 1) ) {
+      continue;
+    }
+    bool  fwd  = ch >= d;               /* ch is the "hi" channel */
+    int   lo   = fwd ? d : ch, hi = fwd ? ch : d;
+    Int64 * h  = cm.hist[cm.pairIdx[lo][hi]].data() + (fwd ? 0 : cm.binCount);
+    const EventWindow & win = cm.window[d];
+    for ( Int32 i = 0; i < win.size(); ++i ) {
+      Int64 diff = time - win.back( i );
+      if ( diff >= range ) {
+        break;
+      }
+      if ( diff >= 0 ) {
+        h[diff / cm.binWidth]++;
+      }
+    }
+  }
+
+  cm.window[ch].push( time );
+  cm.window[ch].dropBefore( time - range );
+}
+
+
+int TDC_CC TDC_enableCorrMatrix( Bln32 enable )
+{
+  std::lock_guard<std::mutex> guard( cm.lock );
+  cm.enabled = enable != 0;
+  if ( cm.enabled ) {
+    clearData();
+  }
+  else {
+    releaseData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setCorrMatrixParams( Int32 binWidth,
+                                    Int32 binCount )
+{
+  if ( binWidth < 1 || binWidth > 1000000 || binCount < 16 || binCount > 65536 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cm.lock );
+  cm.binWidth = binWidth;
+  cm.binCount = binCount;
+  if ( cm.enabled ) {
+    clearData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getCorrMatrixParams( Int32 * binWidth,
+                                    Int32 * binCount )
+{
+  std::lock_guard<std::mutex> guard( cm.lock );
+  if ( binWidth ) {
+    *binWidth = cm.binWidth;
+  }
+  if ( binCount ) {
+    *binCount = cm.binCount;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addCorrPair( Int32 channel1,
+                            Int32 channel2,
+                            Bln32 add )
+{
+  if ( channel1 < 1 || channel1 > CHANNELS || channel2 < 1 || channel2 > CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  int lo = (channel1 < channel2 ? channel1 : channel2) - 1;
+  int hi = (channel1 < channel2 ? channel2 : channel1) - 1;
+
+  std::lock_guard<std::mutex> guard( cm.lock );
+  Int32 & idx = cm.pairIdx[lo][hi];
+  if ( add && idx == NO_PAIR ) {
+    idx = (Int32) cm.hist.size();
+    cm.hist.emplace_back();
+    cm.partners[lo] |= 1u << hi;
+    cm.partners[hi] |= 1u << lo;
+  }
+  else if ( !add && idx != NO_PAIR ) {
+    /* Keep indices dense: move the last pair into the gap */
+    Int32 lastIdx = (Int32) cm.hist.size() - 1;
+    for ( int i = 0; i < CHANNELS; ++i ) {
+      for ( int j = i; j < CHANNELS; ++j ) {
+        if ( cm.pairIdx[i][j] == lastIdx ) {
+          cm.pairIdx[i][j] = idx;
+        }
+      }
+    }
+    cm.hist[idx].swap( cm.hist[lastIdx] );
+    cm.hist.pop_back();
+    idx = NO_PAIR;
+    cm.partners[lo] &= ~(1u << hi);
+    cm.partners[hi] &= ~(1u << lo);
+  }
+  if ( cm.enabled ) {
+    clearData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_resetCorrMatrix( void )
+{
+  std::lock_guard<std::mutex> guard( cm.lock );
+  if ( !cm.enabled ) {
+    return TDC_NotEnabled;
+  }
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addCorrMatrixTimestamps( const Int64 * timestamps,
+                                        const Uint8 * channels,
+                                        Int32         count )
+{
+  if ( count < 0 || (count && (!timestamps || !channels)) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cm.lock );
+  if ( !cm.enabled ) {
+    return TDC_NotEnabled;
+  }
+  for ( Int32 i = 0; i < count; ++i ) {
+    if ( channels[i] < CHANNELS ) {
+      processEvent( channels[i], timestamps[i] );
+    }
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getCorrMatrixEventCount( Int32   channel,
+                                        Int64 * count,
+                                        Int64 * intTime )
+{
+  if ( channel < 1 || channel > CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cm.lock );
+  if ( !cm.enabled ) {
+    return TDC_NotEnabled;
+  }
+  if ( count ) {
+    *count = cm.count[channel - 1];
+  }
+  if ( intTime ) {
+    *intTime = cm.last - cm.first;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getCorrMatrixFunction( Int32             channel1,
+                                      Int32             channel2,
+                                      Bln32             normalize,
+                                      TDC_HbtFunction * fct )
+{
+  if ( channel1 < 1 || channel1 > CHANNELS || channel2 < 1 || channel2 > CHANNELS || !fct ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( cm.lock );
+  if ( !cm.enabled ) {
+    return TDC_NotEnabled;
+  }
+  const Int32 n = cm.binCount;
+  if ( fct ->capacity < 2 * n - 1 ) {
+    return TDC_OutOfRange;
+  }
+  const int   c1 = channel1 - 1, c2 = channel2 - 1;
+  const bool  autoCorr = c1 == c2;
+  const bool  swapped  = c1 > c2;
+  const Int32 idx = cm.pairIdx[swapped ? c2 : c1][swapped ? c1 : c2];
+  if ( idx == NO_PAIR ) {
+    return TDC_NotEnabled;
+  }
+
+  /* Positive arguments of the result: t(channel2) - t(channel1) >= 0 */
+  const Int64 * h   = cm.hist[idx].data();
+  const Int64 * pos = h + (swapped ? n : 0);
+  const Int64 * neg = autoCorr ? pos : h + (swapped ? 0 : n);
+
+  /* Uncorrelated events yield N1 * N2 * binWidth / T pairs per bin */
+  double scale = 1.;
+  if ( normalize ) {
+    double n1 = (double) cm.count[c1], n2 = (double) cm.count[c2];
+    double intTime = (double) (cm.last - cm.first);
+    scale = n1 * n2 > 0. && intTime > 0. ? intTime / (n1 * n2 * cm.binWidth) : 0.;
+  }
+
+  fct ->size        = 2 * n - 1;
+  fct ->binWidth    = cm.binWidth;
+  fct ->indexOffset = n - 1;
+  for ( Int32 k = 1; k < n; ++k ) {
+    fct ->values[n - 1 + k] = pos[k] * scale;
+    fct ->values[n - 1 - k] = neg[k] * scale;
+  }
+  /* Zero bin covers (-binWidth, binWidth); the autocorrelation counts
+   * every pair only once there */
+  fct ->values[n - 1] = autoCorr ? pos[0] * scale
+                                 : (pos[0] + neg[0]) * (normalize ? .5 * scale : 1.);
+  return TDC_Ok;
+}
+
+
+TDC_HbtFunction * TDC_CC TDC_createCorrMatrixFunction( void )
+{
+  Int32 capacity;
+  {
+    std::lock_guard<std::mutex> guard( cm.lock );
+    capacity = 2 * cm.binCount - 1;
+  }
+  TDC_HbtFunction * fct = (TDC_HbtFunction *)
+    malloc( sizeof( TDC_HbtFunction ) + (capacity - 1) * sizeof( double ) );
+  if ( fct ) {
+    fct ->capacity    = capacity;
+    fct ->size        = 0;
+    fct ->binWidth    = 0;
+    fct ->indexOffset = 0;
+  }
+  return fct;
+}
+
+
+void TDC_CC TDC_releaseCorrMatrixFunction( TDC_HbtFunction * fct )
+{
+  free( fct );
+}
@@ -0,0 +1,303 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcdecode.cpp
+ *
+ *  Purpose:        Fast decoding of binary timestamp records
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdcdecode.h"
+#include <atomic>
+#include <cstring>
+
+/* The vector kernels load 16 bytes per 128 bit lane, one record (binary)
+ * or two records (compressed) per lane, and shuffle them into 64 bit
+ * elements. The last load of an iteration reads a few bytes beyond the
+ * records of the iteration, so the loops stop early enough to stay in the
+ * input buffer and the scalar kernel does the rest.
+ *
+ * Compressed timestamps are unwrapped with the 37 bit raw value of the
+ * preceding record; a vector without overflow (the normal case) gets the
+ * common epoch added, one with an overflow is redone by the scalar kernel.
+ *
+ * The vector kernels are compiled with target attributes for GCC and
+ * Clang on x86; other builds only have the scalar kernel.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DECODE_SIMD
+#include <immintrin.h>
+#endif
+
+#define RAW_BITS   37
+#define RAW_MASK   ((1LL << RAW_BITS) - 1)
+
+namespace {
+
+struct Unwrap {                       /* State of compressed decoding */
+  Int64 epoch;                        /* Upper bits added to the raw values */
+  Int64 prev;                         /* Raw value of the previous record */
+};
+
+std::atomic<int> selected( -1 );      /* TDC_DecodeImpl, -1: not resolved */
+
+}
+
+
+static void binaryScalar( const Uint8 * p, Int32 count, Int64 * ts, Uint8 * ch )
+{
+  for ( Int32 i = 0; i < count; ++i, p += TDC_BINARY_RECORD ) {
+    memcpy( ts + i, p, sizeof( Int64 ) );
+    ch[i] = p[8];
+  }
+}
+
+
+static void compressedScalar( const Uint8 * p, Int32 count, Int64 * ts, Uint8 * ch,
+                              Unwrap & uw )
+{
+  for ( Int32 i = 0; i < count; ++i, p += TDC_COMPRESSED_RECORD ) {
+    Int64 v = (Int64) p[0] | (Int64) p[1] << 8 | (Int64) p[2] << 16 |
+              (Int64) p[3] << 24 | (Int64) p[4] << 32;
+    Int64 raw = v & RAW_MASK;
+    if ( raw < uw.prev ) {
+      uw.epoch += 1LL << RAW_BITS;
+    }
+    uw.prev = raw;
+    ts[i]   = uw.epoch + raw;
+    ch[i]   = (Uint8) (v >> RAW_BITS);
+  }
+}
+
+
+#ifdef DECODE_SIMD
+
+__attribute__(( target( "avx2" ) ))
+static inline __m256i loadLanes( const Uint8 * lo, const Uint8 * hi )
+{
+  return _mm256_inserti128_si256(
+    _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *) lo ) ),
+    _mm_loadu_si128( (const __m128i *) hi ), 1 );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static void binaryAvx2( const Uint8 * p, Int32 count, Int64 * ts, Uint8 * ch )
+{
+  /* Byte 0 and 8 of every lane to byte 0 and 1 */
+  const __m256i chShuf = _mm256_setr_epi8( 0, 8, -1, -1, -1, -1, -1, -1,
+                                           -1, -1, -1, -1, -1, -1, -1, -1,
+                                           0, 8, -1, -1, -1, -1, -1, -1,
+                                           -1, -1, -1, -1, -1, -1, -1, -1 );
+  Int32 i = 0;
+  for ( ; i + 5 <= count; i += 4, p += 4 * TDC_BINARY_RECORD ) {
+    __m256i a = loadLanes( p,      p + 10 );           /* Records 0, 1 */
+    __m256i b = loadLanes( p + 20, p + 30 );           /* Records 2, 3 */
+    __m256i t = _mm256_unpacklo_epi64( a, b );         /* 0, 2 | 1, 3 */
+    __m256i h = _mm256_unpackhi_epi64( a, b );
+    t = _mm256_permute4x64_epi64( t, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+    _mm256_storeu_si256( (__m256i *) (ts + i), t );
+    h = _mm256_shuffle_epi8( h, chShuf );              /* 0, 2 | 1, 3 */
+    __m128i c = _mm_unpacklo_epi8( _mm256_castsi256_si128( h ),
+                                   _mm256_extracti128_si256( h, 1 ) );
+    int c4 = _mm_cvtsi128_si32( c );
+    memcpy( ch + i, &c4, 4 );
+  }
+  binaryScalar( p, count - i, ts + i, ch + i );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static void compressedAvx2( const Uint8 * p, Int32 count, Int64 * ts, Uint8 * ch,
+                            Unwrap & uw )
+{
+  /* Two 5 byte records of a lane to two 64 bit elements */
+  const __m256i recShuf = _mm256_setr_epi8( 0, 1, 2, 3, 4, -1, -1, -1,
+                                            5, 6, 7, 8, 9, -1, -1, -1,
+                                            0, 1, 2, 3, 4, -1, -1, -1,
+                                            5, 6, 7, 8, 9, -1, -1, -1 );
+  const __m256i chShuf  = _mm256_setr_epi8( 0, 8, -1, -1, -1, -1, -1, -1,
+                                            -1, -1, -1, -1, -1, -1, -1, -1,
+                                            0, 8, -1, -1, -1, -1, -1, -1,
+                                            -1, -1, -1, -1, -1, -1, -1, -1 );
+  const __m256i mask    = _mm256_set1_epi64x( RAW_MASK );
+  Int32 i = 0;
+  for ( ; i + 6 <= count; i += 4, p += 4 * TDC_COMPRESSED_RECORD ) {
+    __m256i v    = _mm256_shuffle_epi8( loadLanes( p, p + 10 ), recShuf );
+    __m256i raw  = _mm256_and_si256( v, mask );
+    __m256i prev = _mm256_blend_epi32( _mm256_permute4x64_epi64( raw, _MM_SHUFFLE( 2, 1, 0, 0 ) ),
+                                       _mm256_set1_epi64x( uw.prev ), 0x03 );
+    __m256i wrap = _mm256_cmpgt_epi64( prev, raw );
+    if ( !_mm256_testz_si256( wrap, wrap ) ) {
+      compressedScalar( p, 4, ts + i, ch + i, uw );
+      continue;
+    }
+    _mm256_storeu_si256( (__m256i *) (ts + i), _mm256_add_epi64( raw, _mm256_set1_epi64x( uw.epoch ) ) );
+    uw.prev = _mm256_extract_epi64( raw, 3 );
+    __m256i c = _mm256_shuffle_epi8( _mm256_srli_epi64( v, RAW_BITS ), chShuf );
+    int c4 = _mm_cvtsi128_si32( _mm_unpacklo_epi16( _mm256_castsi256_si128( c ),
+                                                    _mm256_extracti128_si256( c, 1 ) ) );
+    memcpy( ch + i, &c4, 4 );
+  }
+  compressedScalar( p, count - i, ts + i, ch + i, uw );
+}
+
+
+__attribute__(( target( "avx512f,avx512bw" ) ))
+static inline __m512i loadLanes4( const Uint8 * p, int stride )
+{
+  __m512i v = _mm512_castsi128_si512( _mm_loadu_si128( (const __m128i *) p ) );
+  v = _mm512_inserti32x4( v, _mm_loadu_si128( (const __m128i *) (p + stride) ),     1 );
+  v = _mm512_inserti32x4( v, _mm_loadu_si128( (const __m128i *) (p + 2 * stride) ), 2 );
+  v = _mm512_inserti32x4( v, _mm_loadu_si128( (const __m128i *) (p + 3 * stride) ), 3 );
+  return v;
+}
+
+
+__attribute__(( target( "avx512f,avx512bw" ) ))
+static void binaryAvx512( const Uint8 * p, Int32 count, Int64 * ts, Uint8 * ch )
+{
+  const __m512i order = _mm512_setr_epi64( 0, 2, 4, 6, 1, 3, 5, 7 );
+  Int32 i = 0;
+  for ( ; i + 9 <= count; i += 8, p += 8 * TDC_BINARY_RECORD ) {
+    __m512i a = loadLanes4( p,      TDC_BINARY_RECORD );   /* Records 0...3 */
+    __m512i b = loadLanes4( p + 40, TDC_BINARY_RECORD );   /* Records 4...7 */
+    __m512i t = _mm512_permutexvar_epi64( order, _mm512_unpacklo_epi64( a, b ) );
+    __m512i h = _mm512_permutexvar_epi64( order, _mm512_unpackhi_epi64( a, b ) );
+    _mm512_storeu_si512( ts + i, t );
+    _mm_storel_epi64( (__m128i *) (ch + i), _mm512_cvtepi64_epi8( h ) );
+  }
+  binaryScalar( p, count - i, ts + i, ch + i );
+}
+
+
+__attribute__(( target( "avx512f,avx512bw" ) ))
+static void compressedAvx512( const Uint8 * p, Int32 count, Int64 * ts, Uint8 * ch,
+                              Unwrap & uw )
+{
+  const __m512i recShuf = _mm512_broadcast_i32x4(
+    _mm_setr_epi8( 0, 1, 2, 3, 4, -1, -1, -1, 5, 6, 7, 8, 9, -1, -1, -1 ) );
+  const __m512i mask = _mm512_set1_epi64( RAW_MASK );
+  Int32 i = 0;
+  for ( ; i + 10 <= count; i += 8, p += 8 * TDC_COMPRESSED_RECORD ) {
+    __m512i v    = _mm512_shuffle_epi8( loadLanes4( p, 2 * TDC_COMPRESSED_RECORD ), recShuf );
+    __m512i raw  = _mm512_and_si512( v, mask );
+    __m512i prev = _mm512_alignr_epi64( raw, _mm512_set1_epi64( uw.prev ), 7 );
+    if ( _mm512_cmpgt_epi64_mask( prev, raw ) ) {
+      compressedScalar( p, 8, ts + i, ch + i, uw );
+      continue;
+    }
+    _mm512_storeu_si512( ts + i, _mm512_add_epi64( raw, _mm512_set1_epi64( uw.epoch ) ) );
+    uw.prev = _mm256_extract_epi64( _mm512_extracti64x4_epi64( raw, 1 ), 3 );
+    _mm_storel_epi64( (__m128i *) (ch + i),
+                      _mm512_cvtepi64_epi8( _mm512_srli_epi64( v, RAW_BITS ) ) );
+  }
+  compressedScalar( p, count - i, ts + i, ch + i, uw );
+}
+
+#endif
+
+
+static bool available( TDC_DecodeImpl impl )
+{
+  switch ( impl ) {
+  case DECODE_AUTO:
+  case DECODE_SCALAR:
+    return true;
+#ifdef DECODE_SIMD
+  case DECODE_AVX2:
+    return __builtin_cpu_supports( "avx2" );
+  case DECODE_AVX512:
+    return __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512bw" );
+#endif
+  default:
+    return false;
+  }
+}
+
+
+static TDC_DecodeImpl currentImpl()
+{
+  int impl = selected.load( std::memory_order_relaxed );
+  if ( impl < 0 ) {
+    impl = available( DECODE_AVX512 ) ? DECODE_AVX512 :
+           available( DECODE_AVX2 )   ? DECODE_AVX2   : DECODE_SCALAR;
+    selected.store( impl, std::memory_order_relaxed );
+  }
+  return (TDC_DecodeImpl) impl;
+}
+
+
+int TDC_CC TDC_setDecodeImpl( TDC_DecodeImpl impl )
+{
+  if ( !available( impl ) ) {
+    return TDC_NotAvailable;
+  }
+  selected.store( impl == DECODE_AUTO ? -1 : impl, std::memory_order_relaxed );
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getDecodeImpl( TDC_DecodeImpl * impl )
+{
+  if ( impl ) {
+    *impl = currentImpl();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_decodeBinary( const Uint8 * records,
+                             Int32         count,
+                             Int64       * timestamps,
+                             Uint8       * channels )
+{
+  if ( count < 0 || (count && (!records || !timestamps || !channels)) ) {
+    return TDC_OutOfRange;
+  }
+  switch ( currentImpl() ) {
+#ifdef DECODE_SIMD
+  case DECODE_AVX512:
+    binaryAvx512( records, count, timestamps, channels );
+    break;
+  case DECODE_AVX2:
+    binaryAvx2( records, count, timestamps, channels );
+    break;
+#endif
+  default:
+    binaryScalar( records, count, timestamps, channels );
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_decodeCompressed( const Uint8 * records,
+                                 Int32         count,
+                                 Int64       * timestamps,
+                                 Uint8       * channels,
+                                 Int64       * last )
+{
+  if ( count < 0 || !last || (count && (!records || !timestamps || !channels)) ) {
+    return TDC_OutOfRange;
+  }
+  Unwrap uw = { *last & ~RAW_MASK, *last & RAW_MASK };
+  switch ( currentImpl() ) {
+#ifdef DECODE_SIMD
+  case DECODE_AVX512:
+    compressedAvx512( records, count, timestamps, channels, uw );
+    break;
+  case DECODE_AVX2:
+    compressedAvx2( records, count, timestamps, channels, uw );
+    break;
+#endif
+  default:
+    compressedScalar( records, count, timestamps, channels, uw );
+  }
+  if ( count ) {
+    *last = timestamps[count - 1];
+  }
+  return TDC_Ok;
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcdevhandle.h
+ *
+ *  Purpose:        Device handles and addressing (internal)
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCDEVHANDLE_H
+#define __TDCDEVHANDLE_H
+
+#include "tdcdevice.h"
+#include "tdcmultidev.h"
+#include "tdcconfig.h"
+#include <mutex>
+
+/** Device handle
+ *
+ *  Lock order: the device lock before the address lock.
+ *  The configuration cache is protected by the device lock.
+ */
+struct TDC_Device {
+  unsigned int     devNo;
+  std::mutex       lock;               /* Serializes the calls to the device */
+  TDC_DevType      type;
+  Int32            channels;
+  TDC_DeviceConfig config;             /* Cached configuration */
+  bool             configValid = false;
+};
+
+
+/** Global lock of the device address of tdcbase */
+std::mutex & deviceAddressLock();
+
+
+/** Scope with the device addressed
+ *
+ *  Holds the device lock for its lifetime and the address lock from
+ *  addressing on. Addressing is done on construction or deferred until
+ *  address() is called; error() tells if addressing failed.
+ */
+class DeviceScope {
+public:
+  explicit DeviceScope( TDC_Device * dev, bool address = true )
+    : _device( dev ), _dev( dev ->lock ), _addr( deviceAddressLock(), std::defer_lock ),
+      _rc( TDC_Ok )
+  {
+    if ( address ) {
+      this ->address();
+    }
+  }
+
+  int address()
+  {
+    if ( !_addr.owns_lock() ) {
+      _addr.lock();
+      _rc = TDC_addressDevice( _device ->devNo );
+    }
+    return _rc;
+  }
+
+  int error() const { return _rc; }
+
+private:
+  TDC_Device *                 _device;
+  std::lock_guard<std::mutex>  _dev;
+  std::unique_lock<std::mutex> _addr;
+  int _rc;
+};
+
+#endif
@@ -0,0 +1,508 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcdevice.cpp
+ *
+ *  Purpose:        Handle based access to multiple devices
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdcdevhandle.h"
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+/* tdcbase keeps one current device address for all calls. Every handle
+ * function holds the address lock from TDC_addressDevice until the
+ * wrapped call returns, so threads working on different devices can't
+ * redirect each other's calls. The device lock is taken first; it keeps
+ * a sequence of calls on one device in order and lets a thread wait for
+ * its device without blocking the address for the others.
+ *
+ * The startup threads only hold the address lock within the handle
+ * functions, so connecting is serialized by tdcbase anyway, but the
+ * calibrations of all devices overlap.
+ */
+
+#define CALIB_POLL     100       /* Calibration state polling [ms] */
+#define CALIB_TIMEOUT  60000     /* Max. calibration time [ms] */
+
+namespace {
+
+struct Registry {
+  std::mutex                 lock;     /* The address lock */
+  std::vector<TDC_Device *>  open;     /* Open handles by device number */
+};
+
+Registry reg;
+
+typedef std::chrono::steady_clock Clock;
+
+struct DeviceStartup {
+  TDC_StartupState  state = STARTUP_PENDING;
+  int               error = TDC_Ok;
+  TDC_Device      * dev   = 0;
+  Clock::time_point since;               /* Start of the current state */
+  Int32             duration[3] = { 0, 0, 0 };  /* Connect, conf., calib. [ms] */
+};
+
+struct Startup {
+  std::mutex                  lock;
+  std::condition_variable     cond;
+  std::vector<DeviceStartup>  devs;
+  std::vector<std::thread>    threads;
+  Int32                       running = 0;
+  Int32                       discover = 0;     /* Discovery time [ms] */
+};
+
+Startup su;
+
+}
+
+
+std::mutex & deviceAddressLock()
+{
+  return reg.lock;
+}
+
+
+/* Calls f with the device addressed; if f modifies the configuration,
+ * the cached one is invalidated.
+ */
+template <class F>
+static int callAddressed( TDC_Device * dev, F f, bool modifies = false )
+{
+  if ( !dev ) {
+    return TDC_NoDevice;
+  }
+  DeviceScope scope( dev );
+  if ( scope.error() != TDC_Ok ) {
+    return scope.error();
+  }
+  if ( modifies ) {
+    dev ->configValid = false;
+  }
+  return f();
+}
+
+
+int TDC_CC TDC_openDevice( unsigned int  devNo,
+                           TDC_Device ** dev )
+{
+  if ( !dev ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( reg.lock );
+  if ( devNo < reg.open.size() && reg.open[devNo] ) {
+    return TDC_DeviceLocked;
+  }
+
+  TDC_DevType type      = DEVTYPE_NONE;
+  Bln32       connected = 0;
+  int rc = TDC_getDeviceInfo( devNo, &type, 0, 0, &connected );
+  if ( rc == TDC_Ok ) {
+    rc = connected ? TDC_addressDevice( devNo ) : TDC_connect( devNo );
+  }
+  if ( rc != TDC_Ok ) {
+    return rc;
+  }
+
+  TDC_Device * d = new TDC_Device;
+  d ->devNo    = devNo;
+  d ->type     = type;
+  d ->channels = TDC_getChannelCount();
+  if ( reg.open.size() <= devNo ) {
+    reg.open.resize( devNo + 1, 0 );
+  }
+  reg.open[devNo] = d;
+  *dev = d;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_closeDevice( TDC_Device * dev )
+{
+  if ( !dev ) {
+    return TDC_NoDevice;
+  }
+  int rc;
+  {
+    std::lock_guard<std::mutex> devGuard( dev ->lock );
+    std::lock_guard<std::mutex> guard( reg.lock );
+    rc = TDC_disconnect( dev ->devNo );
+    reg.open[dev ->devNo] = 0;
+  }
+  {
+    std::lock_guard<std::mutex> guard( su.lock );
+    for ( DeviceStartup & d : su.devs ) {
+      if ( d.dev == dev ) {
+        d.dev = 0;
+      }
+    }
+  }
+  delete dev;
+  return rc;
+}
+
+
+int TDC_CC TDC_getDeviceNo( TDC_Device   * dev,
+                            unsigned int * devNo )
+{
+  if ( !dev ) {
+    return TDC_NoDevice;
+  }
+  if ( devNo ) {
+    *devNo = dev ->devNo;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_callDevice( TDC_Device  * dev,
+                           TDC_DeviceFct fct,
+                           void        * user )
+{
+  if ( !fct ) {
+    return TDC_OutOfRange;
+  }
+  return callAddressed( dev, [&]() { return fct( user ); }, true );
+}
+
+
+int TDC_CC TDC_devEnableChannels( TDC_Device * dev,
+                                  Bln32        enStart,
+                                  Int32        channelMask )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_enableChannels( enStart, channelMask ); }, true );
+}
+
+
+int TDC_CC TDC_devConfigureSignalConditioning( TDC_Device   * dev,
+                                               Int32          channel,
+                                               TDC_SignalCond conditioning,
+                                               Bln32          edge,
+                                               double         threshold )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_configureSignalConditioning( channel, conditioning,
+                                              edge, threshold ); }, true );
+}
+
+
+int TDC_CC TDC_devSetChannelDelay( TDC_Device * dev,
+                                   Int32        channel,
+                                   Int32        delay )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_setChannelDelay( channel, delay ); }, true );
+}
+
+
+int TDC_CC TDC_devConfigureFilter( TDC_Device   * dev,
+                                   Int32          channel,
+                                   TDC_FilterType type,
+                                   Int32          chMask )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_configureFilter( channel, type, chMask ); }, true );
+}
+
+
+int TDC_CC TDC_devSetCoincidenceWindow( TDC_Device * dev,
+                                        Int32        coincWin )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_setCoincidenceWindow( coincWin ); }, true );
+}
+
+
+int TDC_CC TDC_devSetExposureTime( TDC_Device * dev,
+                                   Int32        expTime )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_setExposureTime( expTime ); }, true );
+}
+
+
+int TDC_CC TDC_devGetDeviceParams( TDC_Device * dev,
+                                   Int32      * coincWin,
+                                   Int32      * expTime )
+{
+  if ( !dev ) {
+    return TDC_NoDevice;
+  }
+  DeviceScope scope( dev, false );
+  if ( dev ->configValid ) {
+    if ( coincWin ) {
+      *coincWin = dev ->config.coincWin;
+    }
+    if ( expTime ) {
+      *expTime = dev ->config.expTime;
+    }
+    return TDC_Ok;
+  }
+  if ( scope.address() != TDC_Ok ) {
+    return scope.error();
+  }
+  return TDC_getDeviceParams( coincWin, expTime );
+}
+
+
+int TDC_CC TDC_devSetTimestampBufferSize( TDC_Device * dev,
+                                          Int32        size )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_setTimestampBufferSize( size ); }, true );
+}
+
+
+int TDC_CC TDC_devGetLastTimestamps( TDC_Device * dev,
+                                     Bln32        reset,
+                                     Int64      * timestamps,
+                                     Uint8      * channels,
+                                     Int32      * valid )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_getLastTimestamps( reset, timestamps, channels, valid ); } );
+}
+
+
+int TDC_CC TDC_devGetCoincCounters( TDC_Device * dev,
+                                    Int32      * data,
+                                    Int32      * updates )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_getCoincCounters( data, updates ); } );
+}
+
+
+int TDC_CC TDC_devGetDataLost( TDC_Device * dev,
+                               Bln32      * lost )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_getDataLost( lost ); } );
+}
+
+
+int TDC_CC TDC_devStartCalibration( TDC_Device * dev )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_startCalibration(); } );
+}
+
+
+int TDC_CC TDC_devGetCalibrationState( TDC_Device * dev,
+                                       Bln32      * active )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_getCalibrationState( active ); } );
+}
+
+
+int TDC_CC TDC_devGetClockState( TDC_Device * dev,
+                                 Bln32      * locked,
+                                 Bln32      * uplink )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_getClockState( locked, uplink ); } );
+}
+
+
+int TDC_CC TDC_devEnableExternalClock( TDC_Device * dev,
+                                       Bln32        enable )
+{
+  return callAddressed( dev, [&]() {
+      return TDC_enableExternalClock( enable ); } );
+}
+
+
+/* Enters a new state and accounts the time of the old one; su.lock held */
+static void enterState( DeviceStartup & d, TDC_StartupState state )
+{
+  Clock::time_point now = Clock::now();
+  if ( d.state >= STARTUP_CONNECTING && d.state <= STARTUP_CALIBRATING ) {
+    d.duration[d.state - STARTUP_CONNECTING] = (Int32)
+      std::chrono::duration_cast<std::chrono::milliseconds>( now - d.since ).count();
+  }
+  d.state = state;
+  d.since = now;
+}
+
+
+static void setStartupState( unsigned int devNo, TDC_StartupState state )
+{
+  std::lock_guard<std::mutex> guard( su.lock );
+  enterState( su.devs[devNo], state );
+}
+
+
+/* A handle that is still open, e.g. from a previous startup, is reused */
+static int startupDevice( unsigned int   devNo,
+                          Bln32          calibrate,
+                          TDC_StartupFct configure,
+                          void         * user,
+                          TDC_Device  ** dev,
+                          bool         & reused )
+{
+  setStartupState( devNo, STARTUP_CONNECTING );
+  {
+    std::lock_guard<std::mutex> guard( reg.lock );
+    *dev = devNo < reg.open.size() ? reg.open[devNo] : 0;
+  }
+  reused = *dev != 0;
+  int rc = reused ? TDC_Ok : TDC_openDevice( devNo, dev );
+  if ( rc != TDC_Ok ) {
+    return rc;
+  }
+  if ( configure ) {
+    setStartupState( devNo, STARTUP_CONFIGURING );
+    rc = configure( *dev, user );
+    if ( rc != TDC_Ok ) {
+      return rc;
+    }
+  }
+  if ( calibrate ) {
+    setStartupState( devNo, STARTUP_CALIBRATING );
+    rc = TDC_devStartCalibration( *dev );
+    Bln32 active = 1;
+    for ( int t = 0; rc == TDC_Ok && active; t += CALIB_POLL ) {
+      if ( t >= CALIB_TIMEOUT ) {
+        return TDC_Timeout;
+      }
+      std::this_thread::sleep_for( std::chrono::milliseconds( CALIB_POLL ) );
+      rc = TDC_devGetCalibrationState( *dev, &active );
+    }
+  }
+  return rc;
+}
+
+
+static void startupThread( unsigned int   devNo,
+                           Bln32          calibrate,
+                           TDC_StartupFct configure,
+                           void         * user )
+{
+  TDC_Device * dev    = 0;
+  bool         reused = false;
+  int rc = startupDevice( devNo, calibrate, configure, user, &dev, reused );
+  if ( rc != TDC_Ok && dev ) {
+    if ( !reused ) {
+      TDC_closeDevice( dev );
+    }
+    dev = 0;
+  }
+  std::lock_guard<std::mutex> guard( su.lock );
+  DeviceStartup & d = su.devs[devNo];
+  enterState( d, rc == TDC_Ok ? STARTUP_READY : STARTUP_FAILED );
+  d.error = rc;
+  d.dev   = dev;
+  su.running--;
+  su.cond.notify_all();
+}
+
+
+int TDC_CC TDC_startupDevices( Bln32          calibrate,
+                               TDC_StartupFct configure,
+                               void         * user,
+                               unsigned int * devCount )
+{
+  std::lock_guard<std::mutex> guard( su.lock );
+  if ( su.running ) {
+    return TDC_DeviceLocked;
+  }
+  for ( auto & t : su.threads ) {
+    t.join();
+  }
+  su.threads.clear();
+
+  unsigned int count = 0;
+  int rc;
+  Clock::time_point start = Clock::now();
+  {
+    std::lock_guard<std::mutex> addrGuard( reg.lock );
+    rc = TDC_discover( &count );
+  }
+  su.discover = (Int32)
+    std::chrono::duration_cast<std::chrono::milliseconds>( Clock::now() - start ).count();
+  if ( rc != TDC_Ok ) {
+    return rc;
+  }
+  su.devs.assign( count, DeviceStartup() );
+  su.running = (Int32) count;
+  for ( unsigned int i = 0; i < count; ++i ) {
+    su.threads.emplace_back( startupThread, i, calibrate, configure, user );
+  }
+  if ( devCount ) {
+    *devCount = count;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getStartupState( unsigned int       devNo,
+                                TDC_StartupState * state,
+                                int              * error,
+                                TDC_Device      ** dev )
+{
+  std::lock_guard<std::mutex> guard( su.lock );
+  if ( devNo >= su.devs.size() ) {
+    return TDC_NoDevice;
+  }
+  const DeviceStartup & d = su.devs[devNo];
+  if ( state ) {
+    *state = d.state;
+  }
+  if ( error ) {
+    *error = d.error;
+  }
+  if ( dev ) {
+    *dev = d.dev;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getStartupTiming( unsigned int devNo,
+                                 Int32      * discover,
+                                 Int32      * connect,
+                                 Int32      * configure,
+                                 Int32      * calibrate )
+{
+  std::lock_guard<std::mutex> guard( su.lock );
+  if ( devNo >= su.devs.size() ) {
+    return TDC_NoDevice;
+  }
+  const DeviceStartup & d = su.devs[devNo];
+  if ( discover ) {
+    *discover = su.discover;
+  }
+  if ( connect ) {
+    *connect = d.duration[0];
+  }
+  if ( configure ) {
+    *configure = d.duration[1];
+  }
+  if ( calibrate ) {
+    *calibrate = d.duration[2];
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_waitStartup( Int32 timeout )
+{
+  std::unique_lock<std::mutex> guard( su.lock );
+  if ( !su.cond.wait_for( guard, std::chrono::milliseconds( timeout ),
+                          []() { return su.running == 0; } ) ) {
+    return TDC_Timeout;
+  }
+  for ( auto & t : su.threads ) {
+    t.join();
+  }
+  su.threads.clear();
+  return TDC_Ok;
+}
@@ -0,0 +1,395 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcfit.cpp
+ *
+ *  Purpose:        Batch fitting of g(2) functions and lifetime histograms
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdcfit.h"
+#include "tdcfitcore.h"
+#include "tdcfitmodel.h"
+#include "tdclm.h"
+#include "tdcpool.h"
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+
+namespace {
+
+struct Fit {
+  std::mutex lock;
+  double timebase = 1e-12;
+  double jitter   = 0.;
+  Int32  threads  = 0;
+  TDC_FitMethod method = FITMETHOD_LSQ;
+  Int32  irfBinWidth = 0;
+  std::shared_ptr<const std::vector<double>> irf;
+  std::mutex                  poolLock;  /* Serializes batches */
+  std::unique_ptr<ThreadPool> pool;
+};
+
+Fit fit;
+
+/* Data of a single fit, passed to the model callback */
+struct FitData {
+  bool                hbt;
+  bool                mle;
+  int                 type;
+  double              jitter;
+  std::vector<double> t;
+  double              step;      /* Bin width [s], for the IRF */
+  const std::vector<double> * irf;
+  std::vector<double> scratch = {};  /* Model values of a Jacobian evaluation */
+};
+
+}
+
+
+static void evalModel( const double * par, double * out, void * user )
+{
+  const FitData * d = (const FitData *) user;
+  if ( d ->hbt ) {
+    modelHbtEval( (HBT_FctType) d ->type, par, d ->jitter, d ->t.data(), (int) d ->t.size(), out );
+  }
+  else if ( d ->irf ) {
+    modelLftEvalIrf( (LFT_FctType) d ->type, par, d ->step, d ->irf ->data(), (int) d ->irf ->size(),
+                     (int) d ->t.size(), out );
+  }
+  else {
+    modelLftEval( (LFT_FctType) d ->type, par, d ->t.data(), (int) d ->t.size(), out );
+  }
+}
+
+
+static void evalJacobian( const double * par, double * jac, void * user )
+{
+  FitData * d = (FitData *) user;
+  d ->scratch.resize( d ->t.size() );
+  if ( d ->hbt ) {
+    modelHbtEval( (HBT_FctType) d ->type, par, d ->jitter, d ->t.data(), (int) d ->t.size(),
+                  d ->scratch.data(), jac );
+  }
+  else if ( d ->irf ) {
+    modelLftEvalIrf( (LFT_FctType) d ->type, par, d ->step, d ->irf ->data(), (int) d ->irf ->size(),
+                     (int) d ->t.size(), d ->scratch.data(), jac );
+  }
+  else {
+    modelLftEval( (LFT_FctType) d ->type, par, d ->t.data(), (int) d ->t.size(),
+                  d ->scratch.data(), jac );
+  }
+}
+
+
+/* Runs one fit; par holds the start values and receives the result */
+static void fitOne( FitData      & data,
+                    int            nPar,
+                    const double * y,
+                    double       * par,
+                    TDC_FitResult & result,
+                    double       * errors )
+{
+  int nData = (int) data.t.size();
+  LmResult lm;
+  if ( nPar > 0 ) {
+    LmControl ctl;
+    ctl.errors  = errors != 0;
+    ctl.poisson = data.mle;
+    lmFit( nPar, par, nData, y, evalModel, evalJacobian, &data, ctl, lm );
+    if ( errors ) {
+      std::copy( lm.errors, lm.errors + nPar, errors );
+    }
+  }
+  else {
+    std::vector<double> f( nData );
+    evalModel( par, f.data(), &data );
+    double ss = 0.;
+    for ( int i = 0; i < nData; ++i ) {
+      ss += (y[i] - f[i]) * (y[i] - f[i]);
+    }
+    lm.evaluations = 1;
+    lm.residual    = sqrt( ss );
+  }
+  result.iterations  = lm.iterations;
+  result.evaluations = lm.evaluations;
+  result.residual    = lm.residual;
+}
+
+
+void fitHbtFunction( const TDC_HbtFunction * fct,
+                     HBT_FctType             type,
+                     double                  timebase,
+                     double                  jitter,
+                     double                * par,
+                     TDC_FitResult         & result,
+                     double                * errors )
+{
+  double step = fct ->binWidth * timebase;
+  FitData data { true, false, type, jitter, std::vector<double>( fct ->size ), step, 0 };
+  for ( Int32 k = 0; k < fct ->size; ++k ) {
+    data.t[k] = (k - fct ->indexOffset) * step;
+  }
+  if ( errors ) {
+    std::fill( errors, errors + HBT_PARAM_SIZE, 0. );
+  }
+  fitOne( data, modelHbtParamCount( type ), fct ->values, par, result, errors );
+}
+
+
+LftSetup currentLftSetup()
+{
+  std::lock_guard<std::mutex> guard( fit.lock );
+  LftSetup setup;
+  setup.method      = fit.method;
+  setup.timebase    = fit.timebase;
+  setup.irfBinWidth = fit.irfBinWidth;
+  setup.irf         = fit.irf;
+  return setup;
+}
+
+
+void fitLftFunction( const TDC_LftFunction * fct,
+                     LFT_FctType             type,
+                     const LftSetup        & setup,
+                     double                * par,
+                     TDC_FitResult         & result,
+                     double                * errors )
+{
+  double step = fct ->binWidth * setup.timebase;
+  FitData data { false, setup.method == FITMETHOD_MLE, type, 0., std::vector<double>( fct ->size ),
+                 step, setup.irf.get() };
+  for ( Int32 k = 0; k < fct ->size; ++k ) {
+    data.t[k] = k * step;
+  }
+  if ( errors ) {
+    std::fill( errors, errors + LFT_PARAM_SIZE, 0. );
+  }
+  fitOne( data, modelLftParamCount( type ), fct ->values, par, result, errors );
+}
+
+
+/* Distributes the fits of a batch over the thread pool.
+ * job( i, par, result ) fits function i starting from par.
+ */
+static void runBatch( Int32          count,
+                      Int32          stride,
+                      TDC_FitStart   start,
+                      const double * startParams,
+                      double       * fitParams,
+                      TDC_FitResult * results,
+                      const std::function<void(int, double *, TDC_FitResult &)> & job )
+{
+  std::lock_guard<std::mutex> batchGuard( fit.poolLock );
+  Int32 threads;
+  {
+    std::lock_guard<std::mutex> guard( fit.lock );
+    threads = fit.threads;
+  }
+  if ( threads == 0 ) {
+    threads = std::max( 1, (int) std::thread::hardware_concurrency() );
+  }
+  if ( !fit.pool || fit.pool ->threads() != threads ) {
+    fit.pool.reset();
+    fit.pool.reset( new ThreadPool( threads ) );
+  }
+
+  auto single = [&]( int i, const double * from ) {
+    double * par = fitParams + (size_t) i * stride;
+    if ( par != from ) {
+      std::copy( from, from + stride, par );
+    }
+    TDC_FitResult res;
+    job( i, par, res );
+    if ( results ) {
+      results[i] = res;
+    }
+    return res.iterations >= 0;
+  };
+
+  if ( start == FITSTART_CHAIN ) {
+    int chunks = std::min( (int) count, threads );
+    fit.pool ->run( chunks, [&]( int c ) {
+      int first = (int) ((Int64) count * c / chunks);
+      int last  = (int) ((Int64) count * (c + 1) / chunks);
+      const double * from = startParams;
+      for ( int i = first; i < last; ++i ) {
+        from = single( i, from ) ? fitParams + (size_t) i * stride : startParams;
+      }
+    } );
+  }
+  else {
+    fit.pool ->run( count, [&]( int i ) {
+      single( i, start == FITSTART_PREVIOUS ? fitParams + (size_t) i * stride : startParams );
+    } );
+  }
+}
+
+
+int TDC_CC TDC_setFitParams( double timebase,
+                             double jitter )
+{
+  if ( !(timebase > 0.) || !(jitter >= 0.) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( fit.lock );
+  fit.timebase = timebase;
+  fit.jitter   = jitter;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getFitParams( double * timebase,
+                             double * jitter )
+{
+  std::lock_guard<std::mutex> guard( fit.lock );
+  if ( timebase ) {
+    *timebase = fit.timebase;
+  }
+  if ( jitter ) {
+    *jitter = fit.jitter;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setFitThreads( Int32 threads )
+{
+  if ( threads < 0 || threads > 256 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( fit.lock );
+  fit.threads = threads;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setLftFitMethod( TDC_FitMethod method )
+{
+  if ( method != FITMETHOD_LSQ && method != FITMETHOD_MLE ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( fit.lock );
+  fit.method = method;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getLftFitMethod( TDC_FitMethod * method )
+{
+  std::lock_guard<std::mutex> guard( fit.lock );
+  if ( method ) {
+    *method = fit.method;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setLftIrf( const TDC_LftFunction * irf )
+{
+  std::shared_ptr<std::vector<double>> norm;
+  if ( irf ) {
+    double sum = 0.;
+    Int32  size = 0;
+    for ( Int32 i = 0; i < irf ->size; ++i ) {
+      if ( irf ->values[i] < 0. ) {
+        return TDC_OutOfRange;
+      }
+      sum += irf ->values[i];
+      if ( irf ->values[i] > 0. ) {
+        size = i + 1;            /* Trailing zeros are dropped */
+      }
+    }
+    if ( !(sum > 0.) || irf ->binWidth <= 0 ) {
+      return TDC_OutOfRange;
+    }
+    norm = std::make_shared<std::vector<double>>( irf ->values, irf ->values + size );
+    for ( double & v : *norm ) {
+      v /= sum;
+    }
+  }
+  std::lock_guard<std::mutex> guard( fit.lock );
+  fit.irf         = norm;
+  fit.irfBinWidth = irf ? irf ->binWidth : 0;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_fitHbtBatch( Int32                           count,
+                            const TDC_HbtFunction * const * fcts,
+                            HBT_FctType                     fitType,
+                            TDC_FitStart                    start,
+                            const double                  * startParams,
+                            double                        * fitParams,
+                            TDC_FitResult                 * results )
+{
+  int nPar = modelHbtParamCount( fitType );
+  if ( count < 0 || nPar < 0 || !fitParams || (count > 0 && !fcts) ||
+       start < FITSTART_GIVEN || start > FITSTART_PREVIOUS ) {
+    return TDC_OutOfRange;
+  }
+  for ( Int32 i = 0; i < count; ++i ) {
+    if ( !fcts[i] || fcts[i] ->size < nPar ) {
+      return TDC_OutOfRange;
+    }
+  }
+  double defaults[HBT_PARAM_SIZE] = { 0. };
+  if ( !startParams ) {
+    TDC_getHbtFitStartParams( fitType, defaults );
+    startParams = defaults;
+  }
+  if ( count == 0 ) {
+    return TDC_Ok;
+  }
+
+  double timebase, jitter;
+  TDC_getFitParams( &timebase, &jitter );
+  runBatch( count, HBT_PARAM_SIZE, start, startParams, fitParams, results,
+            [&]( int i, double * par, TDC_FitResult & res ) {
+              fitHbtFunction( fcts[i], fitType, timebase, jitter, par, res, 0 );
+            } );
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_fitLftBatch( Int32                           count,
+                            const TDC_LftFunction * const * fcts,
+                            LFT_FctType                     fitType,
+                            TDC_FitStart                    start,
+                            const double                  * startParams,
+                            double                        * fitParams,
+                            TDC_FitResult                 * results )
+{
+  int nPar = modelLftParamCount( fitType );
+  if ( count < 0 || nPar < 0 || !fitParams || (count > 0 && !fcts) ||
+       (!startParams && start != FITSTART_PREVIOUS) ||
+       start < FITSTART_GIVEN || start > FITSTART_PREVIOUS ) {
+    return TDC_OutOfRange;
+  }
+  for ( Int32 i = 0; i < count; ++i ) {
+    if ( !fcts[i] || fcts[i] ->size < nPar ) {
+      return TDC_OutOfRange;
+    }
+  }
+  if ( count == 0 ) {
+    return TDC_Ok;
+  }
+
+  LftSetup setup = currentLftSetup();
+  for ( Int32 i = 0; i < count; ++i ) {
+    if ( setup.irf && fcts[i] ->binWidth != setup.irfBinWidth ) {
+      return TDC_OutOfRange;
+    }
+  }
+  runBatch( count, LFT_PARAM_SIZE, start, startParams, fitParams, results,
+            [&]( int i, double * par, TDC_FitResult & res ) {
+              fitLftFunction( fcts[i], fitType, setup, par, res, 0 );
+            } );
+  return TDC_Ok;
+}
@@ -0,0 +1,58 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcfitcore.h
+ *
+ *  Purpose:        Single function fits shared by the fit modules (internal)
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCFITCORE_H
+#define __TDCFITCORE_H
+
+#include "tdcfit.h"
+#include <memory>
+#include <vector>
+
+/** Settings of lifetime fits */
+struct LftSetup {
+  TDC_FitMethod method   = FITMETHOD_LSQ;
+  double        timebase = 1e-12;      /**< Duration of a binWidth unit [s] */
+  Int32         irfBinWidth = 0;       /**< Bin width of the IRF */
+  std::shared_ptr<const std::vector<double>> irf;  /**< Normalized IRF; NULL if none */
+};
+
+/** Current settings of lifetime fits */
+LftSetup currentLftSetup();
+
+/** Fit a g(2) function
+ *  @param timebase  Duration of a binWidth unit [s]
+ *  @param jitter    Detector jitter [s] for the models with jitter
+ *  @param par       Input: start values; Output: fitted values;
+ *                   @ref HBT_PARAM_SIZE elements
+ *  @param result    Output: Fit statistics
+ *  @param errors    Output: Standard errors of the parameters,
+ *                   @ref HBT_PARAM_SIZE elements; may be NULL.
+ */
+void fitHbtFunction( const TDC_HbtFunction * fct,
+                     HBT_FctType             type,
+                     double                  timebase,
+                     double                  jitter,
+                     double                * par,
+                     TDC_FitResult         & result,
+                     double                * errors );
+
+/** Fit a lifetime histogram; parameters as for fitHbtFunction,
+ *  with arrays of @ref LFT_PARAM_SIZE elements.
+ *  The bin width of fct must match setup.irfBinWidth if there is an IRF.
+ */
+void fitLftFunction( const TDC_LftFunction * fct,
+                     LFT_FctType             type,
+                     const LftSetup        & setup,
+                     double                * par,
+                     TDC_FitResult         & result,
+                     double                * errors );
+
+#endif
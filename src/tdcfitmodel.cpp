@@ -0,0 +1,462 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcfitmodel.cpp
+ *
+ *  Purpose:        Model functions for g(2) and lifetime fits
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdcfitmodel.h"
+#include <cmath>
+#include <cfloat>
+#include <vector>
+
+/* The definitions follow the model functions of the tdcbase library:
+ *
+ *   Thermal     A exp(-t^2 / 2c^2) + B
+ *   Single      1 - exp(-|t| / t1)
+ *   Three level 1 + pf2 (c exp(-|t| / tb) - (1+c) exp(-|t| / ta))
+ *
+ * The "jitter" variants are convolved with a gaussian of the detector
+ * jitter, the "offset" variants are evaluated at t + dt where dt is the
+ * last parameter.
+ *
+ *   Exp         I0 exp(-t / tau0)
+ *   Dbl. exp    I0 (alpha exp(-t / tau0) + (1-alpha) exp(-t / tau1))
+ *   Kohlrausch  I0 exp(-(t / tau0)^beta)
+ *
+ * Every model is a kernel over the whole time array that yields the values
+ * and, on request, the partial derivatives. The loops are free of calls
+ * except exp/pow/log so that the compiler can vectorize them (see the
+ * compile flags of this file in CMakeLists.txt). The derivative by the
+ * offset is the derivative by t.
+ *
+ * With an instrument response function (IRF) the lifetime models are
+ * convolved with the IRF on the histogram grid. The exponentials use a
+ * recursion of O(n), the Kohlrausch model a direct convolution.
+ */
+
+static const double sqrt2      = 1.4142135623730951;
+static const double sqrt2ByPi  = 0.7978845608028654;   /* sqrt( 2 / pi ) */
+
+
+/* exp(x^2) erfc(x) for x >= 0; Chebyshev fit with a relative error
+ * below 1.2e-7 (Numerical Recipes erfcc), no overflow for large x.
+ */
+static inline double erfcx( double x )
+{
+  double t = 1. / (1. + .5 * x);
+  double p = .17087277;
+  p = -.82215223 + t * p;
+  p = 1.48851587 + t * p;
+  p = -1.13520398 + t * p;
+  p = .27886807 + t * p;
+  p = -.18628806 + t * p;
+  p = .09678418 + t * p;
+  p = .37409196 + t * p;
+  p = 1.00002368 + t * p;
+  p = -1.26551223 + t * p;
+  return t * exp( p );
+}
+
+
+/* One half of the convolution of exp(-|u|/tau) with a normalized gaussian:
+ * exp(sigma^2/2tau^2 - u/tau) erfc(x), x = (sigma/tau - u/sigma) / sqrt2.
+ * g = exp(-u^2/2sigma^2) is common for both halves.
+ */
+static inline double convHalf( double u, double tau, double sigma, double g )
+{
+  double x = (sigma / tau - u / sigma) / sqrt2;
+  double r = g * erfcx( fabs( x ) );
+  double a = fmin( .5 * sigma * sigma / (tau * tau) - u / tau, 0. );
+  return x > 0. ? r : 2. * exp( a ) - r;
+}
+
+
+/* Decay exp(-|u|/tau), optionally convolved with the jitter gaussian;
+ * v = value, du = d/du, dtau = d/dtau.
+ */
+template<bool JIT>
+static inline void decay( double u, double tau, double sigma,
+                          double & v, double & du, double & dtau )
+{
+  if ( JIT ) {
+    double g  = exp( -.5 * u * u / (sigma * sigma) );
+    double fp = convHalf(  u, tau, sigma, g );
+    double fm = convHalf( -u, tau, sigma, g );
+    double it = 1. / tau;
+    double s2 = sigma * sigma * it * it * it;
+    v    = .5 * (fp + fm);
+    du   = -.5 * (fp - fm) * it;
+    dtau = .5 * (fp * (u * it * it - s2) - fm * (u * it * it + s2)) + sqrt2ByPi * sigma * g * it * it;
+  }
+  else {
+    double au = fabs( u );
+    double e  = exp( -au / tau );
+    v    = e;
+    du   = u < 0. ? e / tau : (u > 0. ? -e / tau : 0.);
+    dtau = e * au / (tau * tau);
+  }
+}
+
+
+/* Thermal; the jitter only widens the gaussian */
+static void thermal( const double * p, double sigma, bool ofs,
+                     const double * t, int n, double * out, double * jac )
+{
+  double a = p[0], c = p[1], b = p[2], dt = ofs ? p[3] : 0.;
+  double s2 = c * c + sigma * sigma;
+  if ( s2 <= 0. ) {
+    for ( int i = 0; i < n; ++i ) {
+      out[i] = b;
+    }
+    if ( jac ) {
+      for ( int i = 0; i < n; ++i ) {
+        jac[i] = jac[n + i] = 0.;
+        jac[2 * n + i] = 1.;
+      }
+      if ( ofs ) {
+        for ( int i = 0; i < n; ++i ) {
+          jac[3 * n + i] = 0.;
+        }
+      }
+    }
+    return;
+  }
+  double is2 = 1. / s2;
+  double h   = fabs( c ) * sqrt( is2 );                           /* Amplitude factor */
+  double dh  = (c < 0. ? -1. : 1.) * sigma * sigma * is2 * sqrt( is2 );
+
+  if ( !jac ) {
+#pragma omp simd
+    for ( int i = 0; i < n; ++i ) {
+      double u = t[i] + dt;
+      out[i] = a * h * exp( -.5 * u * u * is2 ) + b;
+    }
+    return;
+  }
+#pragma omp simd
+  for ( int i = 0; i < n; ++i ) {
+    double u = t[i] + dt;
+    double e = exp( -.5 * u * u * is2 );
+    out[i]         = a * h * e + b;
+    jac[i]         = h * e;
+    jac[n + i]     = a * e * (dh + h * u * u * c * is2 * is2);
+    jac[2 * n + i] = 1.;
+    if ( ofs ) {
+      jac[3 * n + i] = -a * h * e * u * is2;
+    }
+  }
+}
+
+
+template<bool JIT>
+static void single( const double * p, double sigma, bool ofs,
+                    const double * t, int n, double * out, double * jac )
+{
+  double tau = p[0], dt = ofs ? p[1] : 0.;
+  double on  = tau > 0. ? 1. : 0.;       /* Decay vanishes for tau <= 0 */
+  if ( tau <= 0. ) {
+    tau = 1.;
+  }
+#pragma omp simd
+  for ( int i = 0; i < n; ++i ) {
+    double v, du, dtau;
+    decay<JIT>( t[i] + dt, tau, sigma, v, du, dtau );
+    out[i] = 1. - on * v;
+    if ( jac ) {
+      jac[i] = -on * dtau;
+      if ( ofs ) {
+        jac[n + i] = -on * du;
+      }
+    }
+  }
+}
+
+
+template<bool JIT>
+static void threeLevel( const double * p, double sigma, bool ofs,
+                        const double * t, int n, double * out, double * jac )
+{
+  double pf2 = p[0], c = p[1], tb = p[2], ta = p[3], dt = ofs ? p[4] : 0.;
+  double onB = tb > 0. ? 1. : 0., onA = ta > 0. ? 1. : 0.;
+  if ( tb <= 0. ) {
+    tb = 1.;
+  }
+  if ( ta <= 0. ) {
+    ta = 1.;
+  }
+#pragma omp simd
+  for ( int i = 0; i < n; ++i ) {
+    double u = t[i] + dt;
+    double vb, dub, dtb, va, dua, dta;
+    decay<JIT>( u, tb, sigma, vb, dub, dtb );
+    decay<JIT>( u, ta, sigma, va, dua, dta );
+    vb *= onB; dub *= onB; dtb *= onB;
+    va *= onA; dua *= onA; dta *= onA;
+    out[i] = 1. + pf2 * (c * vb - (1. + c) * va);
+    if ( jac ) {
+      jac[i]         = c * vb - (1. + c) * va;
+      jac[n + i]     = pf2 * (vb - va);
+      jac[2 * n + i] = pf2 * c * dtb;
+      jac[3 * n + i] = -pf2 * (1. + c) * dta;
+      if ( ofs ) {
+        jac[4 * n + i] = pf2 * (c * dub - (1. + c) * dua);
+      }
+    }
+  }
+}
+
+
+int modelHbtParamCount( HBT_FctType type )
+{
+  switch ( type ) {
+  case FCTTYPE_COHERENT:       return 0;
+  case FCTTYPE_THERMAL:
+  case FCTTYPE_THERM_JIT:      return 3;
+  case FCTTYPE_SINGLE:
+  case FCTTYPE_SINGLE_JIT:     return 1;
+  case FCTTYPE_ANTIBUNCH:
+  case FCTTYPE_ANTIB_JIT:      return 4;
+  case FCTTYPE_THERMAL_OFS:
+  case FCTTYPE_THERM_JIT_OFS:  return 4;
+  case FCTTYPE_SINGLE_OFS:
+  case FCTTYPE_SINGLE_JIT_OFS: return 2;
+  case FCTTYPE_ANTIB_OFS:
+  case FCTTYPE_ANTIB_JIT_OFS:  return 5;
+  default:                     return -1;
+  }
+}
+
+
+int modelLftParamCount( LFT_FctType type )
+{
+  switch ( type ) {
+  case LFTTYPE_EXP:        return 2;
+  case LFTTYPE_DBL_EXP:    return 4;
+  case LFTTYPE_KOHLRAUSCH: return 3;
+  default:                 return -1;
+  }
+}
+
+
+void modelHbtEval( HBT_FctType    type,
+                   const double * params,
+                   double         jitter,
+                   const double * t,
+                   int            n,
+                   double       * out,
+                   double       * jac )
+{
+  bool jit = jitter > 0.;
+  switch ( type ) {
+  case FCTTYPE_THERMAL:        thermal( params, 0.,     false, t, n, out, jac ); break;
+  case FCTTYPE_THERMAL_OFS:    thermal( params, 0.,     true,  t, n, out, jac ); break;
+  case FCTTYPE_THERM_JIT:      thermal( params, jitter, false, t, n, out, jac ); break;
+  case FCTTYPE_THERM_JIT_OFS:  thermal( params, jitter, true,  t, n, out, jac ); break;
+  case FCTTYPE_SINGLE:         single<false>( params, 0., false, t, n, out, jac ); break;
+  case FCTTYPE_SINGLE_OFS:     single<false>( params, 0., true,  t, n, out, jac ); break;
+  case FCTTYPE_SINGLE_JIT:
+    jit ? single<true>( params, jitter, false, t, n, out, jac )
+        : single<false>( params, 0., false, t, n, out, jac );
+    break;
+  case FCTTYPE_SINGLE_JIT_OFS:
+    jit ? single<true>( params, jitter, true, t, n, out, jac )
+        : single<false>( params, 0., true, t, n, out, jac );
+    break;
+  case FCTTYPE_ANTIBUNCH:      threeLevel<false>( params, 0., false, t, n, out, jac ); break;
+  case FCTTYPE_ANTIB_OFS:      threeLevel<false>( params, 0., true,  t, n, out, jac ); break;
+  case FCTTYPE_ANTIB_JIT:
+    jit ? threeLevel<true>( params, jitter, false, t, n, out, jac )
+        : threeLevel<false>( params, 0., false, t, n, out, jac );
+    break;
+  case FCTTYPE_ANTIB_JIT_OFS:
+    jit ? threeLevel<true>( params, jitter, true, t, n, out, jac )
+        : threeLevel<false>( params, 0., true, t, n, out, jac );
+    break;
+  default:
+    for ( int i = 0; i < n; ++i ) {
+      out[i] = type == FCTTYPE_COHERENT ? 1. : 0.;
+    }
+  }
+}
+
+
+void modelLftEval( LFT_FctType    type,
+                   const double * params,
+                   const double * t,
+                   int            n,
+                   double       * out,
+                   double       * jac )
+{
+  const double * p = params;
+  switch ( type ) {
+  case LFTTYPE_EXP: {
+    double i0 = p[0], tau = p[1], on = tau > 0. ? 1. : 0.;
+    if ( tau <= 0. ) {
+      tau = 1.;
+    }
+#pragma omp simd
+    for ( int i = 0; i < n; ++i ) {
+      double e = on * exp( -t[i] / tau );
+      out[i] = i0 * e;
+      if ( jac ) {
+        jac[i]     = e;
+        jac[n + i] = i0 * e * t[i] / (tau * tau);
+      }
+    }
+    break;
+  }
+  case LFTTYPE_DBL_EXP: {
+    double i0 = p[0], alpha = p[1], tau0 = p[2], tau1 = p[3];
+    double on0 = tau0 > 0. ? 1. : 0., on1 = tau1 > 0. ? 1. : 0.;
+    if ( tau0 <= 0. ) {
+      tau0 = 1.;
+    }
+    if ( tau1 <= 0. ) {
+      tau1 = 1.;
+    }
+#pragma omp simd
+    for ( int i = 0; i < n; ++i ) {
+      double e0 = on0 * exp( -t[i] / tau0 );
+      double e1 = on1 * exp( -t[i] / tau1 );
+      out[i] = i0 * (alpha * e0 + (1. - alpha) * e1);
+      if ( jac ) {
+        jac[i]         = alpha * e0 + (1. - alpha) * e1;
+        jac[n + i]     = i0 * (e0 - e1);
+        jac[2 * n + i] = i0 * alpha * e0 * t[i] / (tau0 * tau0);
+        jac[3 * n + i] = i0 * (1. - alpha) * e1 * t[i] / (tau1 * tau1);
+      }
+    }
+    break;
+  }
+  case LFTTYPE_KOHLRAUSCH: {
+    double i0 = p[0], tau = p[1], beta = p[2], on = tau > 0. ? 1. : 0.;
+    if ( tau <= 0. ) {
+      tau = 1.;
+    }
+#pragma omp simd
+    for ( int i = 0; i < n; ++i ) {
+      double x = fmax( t[i] / tau, DBL_MIN );
+      double q = pow( x, beta );
+      double e = on * exp( -q );
+      out[i] = i0 * e;
+      if ( jac ) {
+        jac[i]         = e;
+        jac[n + i]     = i0 * e * q * beta / tau;
+        jac[2 * n + i] = -i0 * e * q * log( x );
+      }
+    }
+    break;
+  }
+  default:
+    for ( int i = 0; i < n; ++i ) {
+      out[i] = 0.;
+    }
+  }
+}
+
+
+/* exp(-t/tau) sampled at t = i step, convolved with the IRF by the
+ * recursion c[i] = q c[i-1] + irf[i], q = exp(-step/tau).
+ * d receives dc/dtau: d[i] = q (d[i-1] + c[i-1] step / tau^2).
+ */
+static void expConv( double tau, double step, const double * irf, int irfSize,
+                     int n, double * c, double * d )
+{
+  if ( tau <= 0. ) {
+    for ( int i = 0; i < n; ++i ) {
+      c[i] = d[i] = 0.;
+    }
+    return;
+  }
+  double q  = exp( -step / tau );
+  double dq = step / (tau * tau);
+  double cPrev = 0., dPrev = 0.;
+  for ( int i = 0; i < n; ++i ) {
+    d[i]  = q * (dPrev + cPrev * dq);
+    c[i]  = q * cPrev + (i < irfSize ? irf[i] : 0.);
+    cPrev = c[i];
+    dPrev = d[i];
+  }
+}
+
+
+/* Direct convolution out[i] = sum( irf[k] in[i-k] ) */
+static void directConv( const double * in, const double * irf, int irfSize,
+                        int n, double * out )
+{
+  for ( int i = 0; i < n; ++i ) {
+    int    kMax = i < irfSize - 1 ? i : irfSize - 1;
+    double s    = 0.;
+    for ( int k = 0; k <= kMax; ++k ) {
+      s += irf[k] * in[i - k];
+    }
+    out[i] = s;
+  }
+}
+
+
+void modelLftEvalIrf( LFT_FctType    type,
+                      const double * params,
+                      double         step,
+                      const double * irf,
+                      int            irfSize,
+                      int            n,
+                      double       * out,
+                      double       * jac )
+{
+  const double * p = params;
+  std::vector<double> c0( n ), d0( n );
+  switch ( type ) {
+  case LFTTYPE_EXP:
+    expConv( p[1], step, irf, irfSize, n, c0.data(), d0.data() );
+    for ( int i = 0; i < n; ++i ) {
+      out[i] = p[0] * c0[i];
+      if ( jac ) {
+        jac[i]     = c0[i];
+        jac[n + i] = p[0] * d0[i];
+      }
+    }
+    break;
+  case LFTTYPE_DBL_EXP: {
+    std::vector<double> c1( n ), d1( n );
+    expConv( p[2], step, irf, irfSize, n, c0.data(), d0.data() );
+    expConv( p[3], step, irf, irfSize, n, c1.data(), d1.data() );
+    for ( int i = 0; i < n; ++i ) {
+      double m = p[1] * c0[i] + (1. - p[1]) * c1[i];
+      out[i] = p[0] * m;
+      if ( jac ) {
+        jac[i]         = m;
+        jac[n + i]     = p[0] * (c0[i] - c1[i]);
+        jac[2 * n + i] = p[0] * p[1] * d0[i];
+        jac[3 * n + i] = p[0] * (1. - p[1]) * d1[i];
+      }
+    }
+    break;
+  }
+  default: {
+    /* No recursion for the stretched exponential: evaluate on the grid
+     * and convolve the values and every derivative
+     */
+    int nPar = modelLftParamCount( type );
+    if ( nPar < 0 ) {
+      nPar = 0;
+    }
+    std::vector<double> t( n ), m( n ), dm( (size_t) nPar * n );
+    for ( int i = 0; i < n; ++i ) {
+      t[i] = i * step;
+    }
+    modelLftEval( type, params, t.data(), n, m.data(), jac ? dm.data() : 0 );
+    directConv( m.data(), irf, irfSize, n, out );
+    if ( jac ) {
+      for ( int k = 0; k < nPar; ++k ) {
+        directConv( dm.data() + (size_t) k * n, irf, irfSize, n, jac + (size_t) k * n );
+      }
+    }
+  }
+  }
+}
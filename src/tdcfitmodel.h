@@ -0,0 +1,64 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcfitmodel.h
+ *
+ *  Purpose:        Model functions for g(2) and lifetime fits (internal)
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCFITMODEL_H
+#define __TDCFITMODEL_H
+
+#include "tdchbt.h"
+#include "tdclifetm.h"
+
+/** Number of parameters of a g(2) model, -1 if invalid */
+int  modelHbtParamCount( HBT_FctType type );
+
+/** Number of parameters of a lifetime model, -1 if invalid */
+int  modelLftParamCount( LFT_FctType type );
+
+/** Evaluate a g(2) model at n time differences t [s]
+ *  @param jitter  Detector jitter [s] for the models with jitter
+ *  @param out     Output: n model values
+ *  @param jac     Output: Partial derivatives, n values per parameter,
+ *                 derivative by parameter k at jac + k * n; may be NULL.
+ */
+void modelHbtEval( HBT_FctType    type,
+                   const double * params,
+                   double         jitter,
+                   const double * t,
+                   int            n,
+                   double       * out,
+                   double       * jac = 0 );
+
+/** Evaluate a lifetime model at n times t [s]
+ *  @param out     Output: n model values
+ *  @param jac     Output: Partial derivatives as for modelHbtEval; may be NULL.
+ */
+void modelLftEval( LFT_FctType    type,
+                   const double * params,
+                   const double * t,
+                   int            n,
+                   double       * out,
+                   double       * jac = 0 );
+
+/** Evaluate a lifetime model at t = i * step, i = 0 ... n-1,
+ *  convolved with an instrument response function
+ *  @param irf     IRF sampled with the same step, normalized to sum 1
+ *  @param out     Output: n model values
+ *  @param jac     Output: Partial derivatives as for modelHbtEval; may be NULL.
+ */
+void modelLftEvalIrf( LFT_FctType    type,
+                      const double * params,
+                      double         step,
+                      const double * irf,
+                      int            irfSize,
+                      int            n,
+                      double       * out,
+                      double       * jac = 0 );
+
+#endif
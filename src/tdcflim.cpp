@@ -0,0 +1,437 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcflim.cpp
+ *
+ *  Purpose:        Pixel resolved lifetime histograms (FLIM)
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdcflim.h"
+#include "tdcsync.h"
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+/* Two cubes are kept: the one being accumulated and the last completed
+ * frame. On frame completion they are swapped, so a frame is never copied
+ * inside the event loop. Channels are stored with their code in the
+ * timestamp stream (0...31, 100...108).
+ */
+
+#define CHANNELS    32
+#define MAX_CUBE    (64 * 1024 * 1024)
+#define MAX_DIVIDER 1024
+
+namespace {
+
+struct Flim {
+  std::mutex  lock;
+  bool        enabled   = false;
+  Int32       pixelsX   = 256;
+  Int32       linesY    = 256;
+  Int32       pixelTime = 10000000;
+  Int32       lineDelay = 0;
+  Int32       frames    = 1;
+  Int32       binWidth  = 50;
+  Int32       binCount  = 256;
+  Int32       startChan = 1;
+  Int32       lineChan  = 100;
+  Int32       frameChan = 101;
+  unsigned    stopMask  = 0;          /* Bitmask of stop channels */
+  std::vector<Int32> cube;            /* Frame being accumulated */
+  std::vector<Int32> intensity;
+  std::vector<Int32> doneCube;        /* Last completed frame */
+  std::vector<Int32> doneIntensity;
+  Int32       frameNo   = 0;          /* Number of completed frames */
+  Int32       scanned   = 0;          /* Frames integrated in cube */
+  Int32       line      = -1;         /* Current line, -1 before the first */
+  bool        inFrame   = false;      /* A frame is being scanned */
+  Int64       lineStart = 0;
+  Int64       lastStart = 0;
+  bool        started   = false;      /* A start event has been seen */
+  SyncModel   sync;                   /* Used if divider > 1 */
+};
+
+Flim fl;
+
+}
+
+
+static bool validChannel( Int32 ch )
+{
+  return (ch >= 1 && ch <= CHANNELS) || (ch >= 100 && ch <= 108 && ch != 104);
+}
+
+
+/* Channel code in the timestamp stream */
+static int streamCode( Int32 ch )
+{
+  return ch <= CHANNELS ? ch - 1 : ch;
+}
+
+
+static bool validSize( Int32 pixelsX, Int32 linesY, Int32 binCount )
+{
+  return (Int64) pixelsX * linesY * binCount <= MAX_CUBE;
+}
+
+
+static void clearData()
+{
+  std::fill( fl.cube.begin(), fl.cube.end(), 0 );
+  std::fill( fl.intensity.begin(), fl.intensity.end(), 0 );
+  fl.frameNo = 0;
+  fl.scanned = 0;
+  fl.line    = -1;
+  fl.inFrame = false;
+  fl.started = false;
+  fl.sync.reset();
+}
+
+
+static void allocate()
+{
+  size_t pixels = (size_t) fl.pixelsX * fl.linesY;
+  std::vector<Int32>( pixels * fl.binCount ).swap( fl.cube );
+  std::vector<Int32>( pixels ).swap( fl.intensity );
+  std::vector<Int32>().swap( fl.doneCube );
+  std::vector<Int32>().swap( fl.doneIntensity );
+  clearData();
+}
+
+
+static void release()
+{
+  std::vector<Int32>().swap( fl.cube );
+  std::vector<Int32>().swap( fl.intensity );
+  std::vector<Int32>().swap( fl.doneCube );
+  std::vector<Int32>().swap( fl.doneIntensity );
+  clearData();
+}
+
+
+static void completeFrame()
+{
+  if ( ++fl.scanned < fl.frames ) {
+    return;
+  }
+  fl.doneCube.swap( fl.cube );
+  fl.doneIntensity.swap( fl.intensity );
+  fl.cube.assign( fl.doneCube.size(), 0 );
+  fl.intensity.assign( fl.doneIntensity.size(), 0 );
+  fl.scanned = 0;
+  fl.frameNo++;
+}
+
+
+static void processEvents( const Int64 * timestamps, const Uint8 * channels, Int32 count )
+{
+  const int   start     = streamCode( fl.startChan );
+  const int   lineCh    = streamCode( fl.lineChan );
+  const int   frameCh   = fl.frameChan ? streamCode( fl.frameChan ) : -1;
+  const Int64 pixelTime = fl.pixelTime;
+  const Int64 lineDelay = fl.lineDelay;
+  const Int64 binWidth  = fl.binWidth;
+  const Int32 binCount  = fl.binCount;
+  const Int32 pixelsX   = fl.pixelsX;
+  const Int32 linesY    = fl.linesY;
+  const bool  divided   = fl.sync.divider() > 1;
+
+  for ( Int32 i = 0; i < count; ++i ) {
+    int ch = channels[i];
+    if ( ch == start ) {
+      if ( divided ) {
+        fl.sync.start( timestamps[i] );
+        continue;
+      }
+      fl.lastStart = timestamps[i];
+      fl.started   = true;
+      continue;
+    }
+    if ( ch == frameCh ) {
+      if ( fl.inFrame ) {
+        completeFrame();
+      }
+      fl.inFrame = true;
+      fl.line    = -1;
+      continue;
+    }
+    if ( ch == lineCh ) {
+      if ( frameCh < 0 && !fl.inFrame ) {
+        fl.inFrame = true;
+        fl.line    = -1;
+      }
+      if ( !fl.inFrame ) {
+        continue;
+      }
+      fl.lineStart = timestamps[i];
+      if ( ++fl.line >= linesY && frameCh < 0 ) {
+        completeFrame();
+        fl.line = 0;
+      }
+      continue;
+    }
+    if ( ch >= CHANNELS || !(fl.stopMask & (1u << ch)) ||
+         !(divided ? fl.sync.locked() : fl.started) || fl.line < 0 || fl.line >= linesY ) {
+      continue;
+    }
+    Int64 delay = divided ? (Int64) fl.sync.delay( timestamps[i] )
+                          : timestamps[i] - fl.lastStart;
+    Int64 pos   = timestamps[i] - fl.lineStart - lineDelay;
+    if ( delay < 0 || pos < 0 ) {
+      continue;
+    }
+    Int64 bin = delay / binWidth;
+    Int64 x   = pos / pixelTime;
+    if ( bin >= binCount || x >= pixelsX ) {
+      continue;
+    }
+    Int32 pixel = fl.line * pixelsX + (Int32) x;
+    fl.cube[(size_t) pixel * binCount + bin]++;
+    fl.intensity[pixel]++;
+  }
+}
+
+
+int TDC_CC TDC_enableFlim( Bln32 enable )
+{
+  std::lock_guard<std::mutex> guard( fl.lock );
+  fl.enabled = enable != 0;
+  if ( fl.enabled ) {
+    allocate();
+  }
+  else {
+    release();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setFlimImage( Int32 pixelsX,
+                             Int32 linesY,
+                             Int32 pixelTime,
+                             Int32 lineDelay,
+                             Int32 frames )
+{
+  if ( pixelsX < 1 || pixelsX > 4096 || linesY < 1 || linesY > 4096 ||
+       pixelTime < 1 || pixelTime > 1000000000 || lineDelay < 0 || lineDelay > 1000000000 ||
+       frames < 1 || frames > 1000000 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( fl.lock );
+  if ( !validSize( pixelsX, linesY, fl.binCount ) ) {
+    return TDC_OutOfRange;
+  }
+  fl.pixelsX   = pixelsX;
+  fl.linesY    = linesY;
+  fl.pixelTime = pixelTime;
+  fl.lineDelay = lineDelay;
+  fl.frames    = frames;
+  if ( fl.enabled ) {
+    allocate();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getFlimImage( Int32 * pixelsX,
+                             Int32 * linesY,
+                             Int32 * pixelTime,
+                             Int32 * lineDelay,
+                             Int32 * frames )
+{
+  std::lock_guard<std::mutex> guard( fl.lock );
+  if ( pixelsX ) {
+    *pixelsX = fl.pixelsX;
+  }
+  if ( linesY ) {
+    *linesY = fl.linesY;
+  }
+  if ( pixelTime ) {
+    *pixelTime = fl.pixelTime;
+  }
+  if ( lineDelay ) {
+    *lineDelay = fl.lineDelay;
+  }
+  if ( frames ) {
+    *frames = fl.frames;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setFlimHistogram( Int32 binWidth,
+                                 Int32 binCount )
+{
+  if ( binWidth < 1 || binWidth > 1000000 || binCount < 1 || binCount > 4096 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( fl.lock );
+  if ( !validSize( fl.pixelsX, fl.linesY, binCount ) ) {
+    return TDC_OutOfRange;
+  }
+  fl.binWidth = binWidth;
+  fl.binCount = binCount;
+  if ( fl.enabled ) {
+    allocate();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getFlimHistogram( Int32 * binWidth,
+                                 Int32 * binCount )
+{
+  std::lock_guard<std::mutex> guard( fl.lock );
+  if ( binWidth ) {
+    *binWidth = fl.binWidth;
+  }
+  if ( binCount ) {
+    *binCount = fl.binCount;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setFlimInput( Int32 startChan,
+                             Int32 lineChan,
+                             Int32 frameChan )
+{
+  if ( !validChannel( startChan ) || !validChannel( lineChan ) ||
+       (frameChan && !validChannel( frameChan )) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( fl.lock );
+  fl.startChan = startChan;
+  fl.lineChan  = lineChan;
+  fl.frameChan = frameChan;
+  if ( fl.enabled ) {
+    allocate();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getFlimInput( Int32 * startChan,
+                             Int32 * lineChan,
+                             Int32 * frameChan )
+{
+  std::lock_guard<std::mutex> guard( fl.lock );
+  if ( startChan ) {
+    *startChan = fl.startChan;
+  }
+  if ( lineChan ) {
+    *lineChan = fl.lineChan;
+  }
+  if ( frameChan ) {
+    *frameChan = fl.frameChan;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setFlimSyncDivider( Int32 divider )
+{
+  if ( divider < 1 || divider > MAX_DIVIDER ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( fl.lock );
+  fl.sync.setDivider( divider );
+  if ( fl.enabled ) {
+    allocate();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getFlimSyncDivider( Int32  * divider,
+                                   double * period )
+{
+  std::lock_guard<std::mutex> guard( fl.lock );
+  if ( divider ) {
+    *divider = fl.sync.divider();
+  }
+  if ( period ) {
+    *period = fl.sync.period();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addFlimChannel( Int32 stopCh,
+                               Bln32 add )
+{
+  if ( stopCh < 1 || stopCh > CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( fl.lock );
+  unsigned bit = 1u << (stopCh - 1);
+  if ( !add == !(fl.stopMask & bit) ) {
+    return TDC_Ok;
+  }
+  fl.stopMask ^= bit;
+  if ( fl.enabled ) {
+    allocate();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_resetFlim( void )
+{
+  std::lock_guard<std::mutex> guard( fl.lock );
+  if ( !fl.enabled ) {
+    return TDC_NotEnabled;
+  }
+  allocate();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addFlimTimestamps( const Int64 * timestamps,
+                                  const Uint8 * channels,
+                                  Int32         count )
+{
+  if ( count < 0 || (count && (!timestamps || !channels)) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( fl.lock );
+  if ( !fl.enabled ) {
+    return TDC_NotEnabled;
+  }
+  processEvents( timestamps, channels, count );
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getFlimFrame( Int32 * cube,
+                             Int64   cubeSize,
+                             Int32 * intensity,
+                             Int32   pixelCount,
+                             Int32 * frameNo )
+{
+  std::lock_guard<std::mutex> guard( fl.lock );
+  if ( !fl.enabled ) {
+    return TDC_NotEnabled;
+  }
+  if ( !fl.frameNo ) {
+    return TDC_NotAvailable;
+  }
+  if ( (cube && cubeSize < (Int64) fl.doneCube.size()) ||
+       (intensity && pixelCount < (Int64) fl.doneIntensity.size()) ) {
+    return TDC_OutOfRange;
+  }
+  if ( cube ) {
+    std::copy( fl.doneCube.begin(), fl.doneCube.end(), cube );
+  }
+  if ( intensity ) {
+    std::copy( fl.doneIntensity.begin(), fl.doneIntensity.end(), intensity );
+  }
+  if ( frameNo ) {
+    *frameNo = fl.frameNo;
+  }
+  return TDC_Ok;
+}
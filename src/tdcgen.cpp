@@ -0,0 +1,710 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcgen.cpp
+ *
+ *  Purpose:        Synthetic event streams with photon statistics
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdcgen.h"
+#include "tdcbase.h"
+#include "tdcpool.h"
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+/* The stream is generated in windows of about WINDOW_EVENTS events.
+ * A window is split into tasks: memoryless models (Poisson, pulsed,
+ * sync) into time slices with a stream key of their own, the models
+ * with memory into one task per channel that continues the state and
+ * the stream of the channel. The tasks run on the thread pool, each
+ * into its own sorted list. Fluorescence decays that reach beyond the
+ * window are kept for the next one. The window is then cut into groups
+ * whose events are combined in parallel by a bucket sort.
+ */
+
+#define CHANNELS       32
+#define WINDOW_EVENTS  (1024 * 1024)  /* Expected events per window */
+#define SLICE_EVENTS   (64 * 1024)    /* Expected events per slice */
+#define MAX_SLICES     64
+#define MAX_WINDOW     ((Int64) 1000000000000) /* 1 s */
+#define BUCKET_EVENTS  8              /* Mean events per sort bucket */
+#define MAX_BUCKETS    (4 * 1024 * 1024)
+#define MAX_RATE       1.e10
+#define MAX_EXCITATION 1.e12
+#define MAX_TIME       1.e12
+#define MAX_LIFETIME   1.e9
+
+static const uint64_t golden = 0x9e3779b97f4a7c15ULL;
+
+namespace {
+
+struct Event {
+  Int64 time;
+  Int32 channel;                      /* Stream code 0...31 */
+};
+
+/* Counter-based random numbers: number n of the stream with the given
+ * key is a hash of key + n, so a stream can start anywhere.
+ */
+class Random {
+public:
+  Random( uint64_t key, uint64_t counter ) : _key( key ), _counter( counter ) {}
+
+  uint64_t counter() const { return _counter; }
+
+  uint64_t next() { return mix( _key + _counter++ * golden ); }
+
+  /** Uniform in (0, 1] */
+  double uniform() { return ((next() >> 11) + 1) * (1. / 9007199254740992.); }
+
+  /** Exponential with the given mean */
+  double exponential( double mean ) { return -log( uniform() ) * mean; }
+
+  static uint64_t mix( uint64_t z )
+  {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+private:
+  uint64_t _key;
+  uint64_t _counter;
+};
+
+struct Channel {
+  TDC_GenModel model = GEN_OFF;
+  double       par[TDC_GEN_PARAMS] = { 0., 0., 0., 0. };
+  bool         init    = true;        /* State must be initialized */
+  uint64_t     counter = 0;           /* Position in the stream of the channel */
+  Int64        cur     = 0;           /* Bursts: time generated up to */
+  Int64        toggle  = 0;           /* Bursts: end of the current state */
+  bool         on      = false;       /* Bursts: in a burst */
+  Int64        next    = 0;           /* Antibunched: next emission */
+};
+
+struct Task {
+  Int32    channel;                   /* Stream code; sync if syncTask */
+  bool     syncTask;
+  Int64    begin, end;
+  uint64_t key;
+  std::vector<Event> events;
+};
+
+struct Group {
+  Int64              begin, end;      /* Part of the window */
+  std::vector<Int32> lo, hi;          /* Events of the group per list */
+  std::vector<Int32> used;            /* Lists with events in the group */
+  Int32              count;
+  Int32              offset;          /* In the ready buffer */
+  std::vector<Int32> bucketStart;
+  std::vector<Int32> fill;
+  std::vector<Event> sorted;
+};
+
+struct Generator {
+  std::mutex  lock;
+  Channel     ch[CHANNELS];
+  Int32       period   = 12500;
+  Int32       syncChan = 0;
+  Int32       threads  = 0;
+  uint64_t    seed     = 0;
+  Int64       time     = 0;           /* End of the last window */
+  Int64       window   = 0;           /* Number of windows generated */
+  Int64       events   = 0;           /* Events retrieved */
+  std::vector<Task>  tasks;
+  Int32              taskCount = 0;
+  std::vector<Event> pending;         /* Events beyond the last window */
+  std::vector<Event> nextPending;
+  std::vector<std::vector<Event> *> lists;   /* Pending and task lists */
+  std::vector<Int32> inWindow;        /* Events of a list in the window */
+  std::vector<Group> groups;
+  std::vector<Int64> readyTs;         /* Sorted events of the last window */
+  std::vector<Uint8> readyCh;
+  size_t             readyPos = 0;
+  std::unique_ptr<ThreadPool> pool;
+};
+
+Generator gen;
+
+}
+
+
+static bool earlier( const Event & a, const Event & b )
+{
+  return a.time < b.time || (a.time == b.time && a.channel < b.channel);
+}
+
+
+static bool beforeTime( const Event & e, Int64 t )
+{
+  return e.time < t;
+}
+
+
+static bool memoryless( TDC_GenModel model )
+{
+  return model == GEN_POISSON || model == GEN_PULSED;
+}
+
+
+/* Expected rate of a channel model [events/s] */
+static double channelRate( const Channel & c )
+{
+  const double * p = c.par;
+  switch ( c.model ) {
+  case GEN_POISSON:     return p[0];
+  case GEN_BUNCHED:     return p[0];
+  case GEN_ANTIBUNCHED: return p[2] / (1. / p[0] + p[1] * 1.e-12);
+  case GEN_PULSED:      return p[0] * 1.e12 / gen.period;
+  case GEN_BURST:       return p[0] * p[1] / (p[1] + p[2]) + p[3];
+  default:              return 0.;
+  }
+}
+
+
+static double totalRate()
+{
+  double rate = gen.syncChan ? 1.e12 / gen.period : 0.;
+  for ( int i = 0; i < CHANNELS; ++i ) {
+    rate += channelRate( gen.ch[i] );
+  }
+  return rate;
+}
+
+
+static bool validParams( TDC_GenModel model, const double * p )
+{
+  switch ( model ) {
+  case GEN_OFF:
+    return true;
+  case GEN_POISSON:
+    return p[0] > 0. && p[0] <= MAX_RATE;
+  case GEN_BUNCHED:
+    return p[0] > 0. && p[0] <= MAX_RATE && p[1] >= 1. && p[1] <= MAX_TIME;
+  case GEN_ANTIBUNCHED:
+    return p[0] > 0. && p[0] <= MAX_EXCITATION && p[1] >= 0. && p[1] <= MAX_LIFETIME &&
+           p[2] > 0. && p[2] <= 1.;
+  case GEN_PULSED:
+    return p[0] > 0. && p[0] <= 1. && p[1] >= 0. && p[1] <= MAX_LIFETIME &&
+           p[2] >= 0. && p[2] <= MAX_LIFETIME;
+  case GEN_BURST:
+    return p[0] > 0. && p[0] <= MAX_RATE && p[1] >= 1. && p[1] <= MAX_TIME &&
+           p[2] >= 1. && p[2] <= MAX_TIME && p[3] >= 0. && p[3] <= MAX_RATE;
+  default:
+    return false;
+  }
+}
+
+
+static void genPoisson( Task & t, double rate )
+{
+  Random rnd( t.key, 0 );
+  double mean = 1.e12 / rate;
+  double span = (double) (t.end - t.begin);
+  for ( double x = rnd.exponential( mean ); x < span; x += rnd.exponential( mean ) ) {
+    t.events.push_back( { t.begin + (Int64) x, t.channel } );
+  }
+}
+
+
+/* Pulses in the slice, each detected with probability p; the number of
+ * undetected pulses in between is geometrically distributed.
+ */
+static void genPulsed( Task & t, double p, double lifetime, Int64 delay )
+{
+  Random rnd( t.key, 0 );
+  const Int64 period  = gen.period;
+  const Int64 last    = (t.end - 1) / period;
+  double      logMiss = p < 1. ? log1p( -p ) : 0.;
+  for ( Int64 k = (t.begin + period - 1) / period; k <= last; ++k ) {
+    if ( p < 1. ) {
+      double skip = log( rnd.uniform() ) / logMiss;
+      if ( skip > (double) (last - k) ) {
+        break;
+      }
+      k += (Int64) skip;
+    }
+    Int64 decay = lifetime > 0. ? (Int64) rnd.exponential( lifetime ) : 0;
+    t.events.push_back( { k * period + delay + decay, t.channel } );
+  }
+}
+
+
+static void genSync( Task & t )
+{
+  const Int64 period = gen.period;
+  for ( Int64 k = (t.begin + period - 1) / period; k * period < t.end; ++k ) {
+    t.events.push_back( { k * period, t.channel } );
+  }
+}
+
+
+/* Poisson events at a rate that switches between bursts and gaps */
+static void genBurst( Task & t, Channel & c, uint64_t key, double rateOn,
+                      double durOn, double durOff, double background )
+{
+  Random rnd( key, c.counter );
+  if ( c.init ) {
+    c.on     = rnd.uniform() * (durOn + durOff) <= durOn;
+    c.cur    = t.begin;
+    c.toggle = t.begin + (Int64) rnd.exponential( c.on ? durOn : durOff ) + 1;
+    c.init   = false;
+  }
+  for ( ;; ) {
+    Int64  limit = std::min( c.toggle, t.end );
+    double rate  = (c.on ? rateOn : 0.) + background;
+    if ( rate > 0. ) {
+      double mean = 1.e12 / rate;
+      double span = (double) (limit - c.cur);
+      for ( double x = rnd.exponential( mean ); x < span; x += rnd.exponential( mean ) ) {
+        t.events.push_back( { c.cur + (Int64) x, t.channel } );
+      }
+    }
+    c.cur = limit;
+    if ( c.toggle >= t.end ) {
+      break;
+    }
+    c.on      = !c.on;
+    c.toggle += (Int64) rnd.exponential( c.on ? durOn : durOff ) + 1;
+  }
+  c.counter = rnd.counter();
+}
+
+
+/* Excitation and decay of a single emitter; an emission is detected
+ * with the detection efficiency.
+ */
+static void genAntibunched( Task & t, Channel & c, uint64_t key )
+{
+  Random rnd( key, c.counter );
+  double excite   = 1.e12 / c.par[0];
+  double lifetime = c.par[1];
+  double eff      = c.par[2];
+  if ( c.init ) {
+    c.next = t.begin + (Int64) (rnd.exponential( excite ) + rnd.exponential( lifetime ));
+    c.init = false;
+  }
+  while ( c.next < t.end ) {
+    if ( eff >= 1. || rnd.uniform() <= eff ) {
+      t.events.push_back( { c.next, t.channel } );
+    }
+    c.next += (Int64) (rnd.exponential( excite ) + rnd.exponential( lifetime )) + 1;
+  }
+  c.counter = rnd.counter();
+}
+
+
+static void runTask( Task & t )
+{
+  t.events.clear();
+  if ( t.syncTask ) {
+    genSync( t );
+    return;
+  }
+  Channel & c = gen.ch[t.channel];
+  const double * p = c.par;
+  switch ( c.model ) {
+  case GEN_POISSON:
+    genPoisson( t, p[0] );
+    break;
+  case GEN_PULSED:
+    genPulsed( t, p[0], p[1], (Int64) p[2] );
+    break;
+  case GEN_BUNCHED:
+    /* Symmetric switching between 0 and twice the rate */
+    genBurst( t, c, t.key, 2. * p[0], 2. * p[1], 2. * p[1], 0. );
+    break;
+  case GEN_BURST:
+    genBurst( t, c, t.key, p[0], p[1], p[2], p[3] );
+    break;
+  case GEN_ANTIBUNCHED:
+    genAntibunched( t, c, t.key );
+    break;
+  default:
+    break;
+  }
+  if ( !std::is_sorted( t.events.begin(), t.events.end(), earlier ) ) {
+    std::sort( t.events.begin(), t.events.end(), earlier );
+  }
+}
+
+
+static Task & addTask( Int32 channel, bool syncTask, Int64 begin, Int64 end, uint64_t key )
+{
+  if ( gen.taskCount == (Int32) gen.tasks.size() ) {
+    gen.tasks.emplace_back();
+  }
+  Task & t    = gen.tasks[gen.taskCount++];
+  t.channel   = channel;
+  t.syncTask  = syncTask;
+  t.begin     = begin;
+  t.end       = end;
+  t.key       = key;
+  return t;
+}
+
+
+/* Slices of a memoryless stream in the window */
+static void addSlices( Int32 channel, bool syncTask, double rate, Int64 begin, Int64 width )
+{
+  Int64 slices = (Int64) (rate * width * 1.e-12 / SLICE_EVENTS);
+  slices = std::max( (Int64) 1, std::min( slices, (Int64) MAX_SLICES ) );
+  uint64_t key = Random::mix( Random::mix( gen.seed + channel + (syncTask ? CHANNELS : 0) ) +
+                              gen.window );
+  for ( Int64 s = 0; s < slices; ++s ) {
+    addTask( channel, syncTask, begin + width * s / slices, begin + width * (s + 1) / slices,
+             Random::mix( key + s ) );
+  }
+}
+
+
+/* Sorts the events of a group into the ready buffer. Lists that don't
+ * overlap in time, like the slices of one channel, are concatenated,
+ * others are combined by a bucket sort over the duration of the group.
+ */
+static void mergeGroup( Group & gr, const std::vector<std::vector<Event> *> & lists )
+{
+  Int64 * ts = gen.readyTs.data() + gr.offset;
+  Uint8 * ch = gen.readyCh.data() + gr.offset;
+
+  std::vector<Int32> & used = gr.used;
+  used.clear();
+  for ( size_t l = 0; l < lists.size(); ++l ) {
+    if ( gr.hi[l] > gr.lo[l] ) {
+      used.push_back( (Int32) l );
+    }
+  }
+  auto first = [&]( Int32 l ) { return (*lists[l])[gr.lo[l]].time; };
+  auto last  = [&]( Int32 l ) { return (*lists[l])[gr.hi[l] - 1].time; };
+  std::sort( used.begin(), used.end(), [&]( Int32 a, Int32 b ) { return first( a ) < first( b ); } );
+  bool disjoint = true;
+  for ( size_t u = 1; u < used.size() && disjoint; ++u ) {
+    disjoint = last( used[u - 1] ) < first( used[u] );
+  }
+  if ( disjoint ) {
+    Int32 n = 0;
+    for ( Int32 l : used ) {
+      const Event * e = lists[l] ->data();
+      for ( Int32 i = gr.lo[l]; i < gr.hi[l]; ++i, ++n ) {
+        ts[n] = e[i].time;
+        ch[n] = (Uint8) e[i].channel;
+      }
+    }
+    return;
+  }
+
+  const Int64 span    = gr.end - gr.begin;
+  const Int64 buckets = std::max( (Int64) 1, std::min( (Int64) gr.count / BUCKET_EVENTS,
+                                                       (Int64) MAX_BUCKETS ) );
+  std::vector<Int32> & start = gr.bucketStart;
+  start.assign( buckets + 1, 0 );
+  for ( size_t l = 0; l < lists.size(); ++l ) {
+    const Event * e = lists[l] ->data();
+    for ( Int32 i = gr.lo[l]; i < gr.hi[l]; ++i ) {
+      start[(e[i].time - gr.begin) * buckets / span + 1]++;
+    }
+  }
+  for ( Int64 b = 0; b < buckets; ++b ) {
+    start[b + 1] += start[b];
+  }
+  gr.fill.assign( start.begin(), start.end() - 1 );
+  gr.sorted.resize( gr.count );
+  for ( size_t l = 0; l < lists.size(); ++l ) {
+    const Event * e = lists[l] ->data();
+    for ( Int32 i = gr.lo[l]; i < gr.hi[l]; ++i ) {
+      gr.sorted[gr.fill[(e[i].time - gr.begin) * buckets / span]++] = e[i];
+    }
+  }
+  Event * data = gr.sorted.data();
+  for ( Int64 b = 0; b < buckets; ++b ) {
+    std::sort( data + start[b], data + start[b + 1], earlier );
+  }
+  for ( Int32 i = 0; i < gr.count; ++i ) {
+    ts[i] = data[i].time;
+    ch[i] = (Uint8) data[i].channel;
+  }
+}
+
+
+static void ensurePool()
+{
+  Int32 threads = gen.threads;
+  if ( threads == 0 ) {
+    threads = std::max( 1, (int) std::thread::hardware_concurrency() );
+  }
+  if ( !gen.pool || gen.pool ->threads() != threads ) {
+    gen.pool.reset();
+    gen.pool.reset( new ThreadPool( threads ) );
+  }
+}
+
+
+/* Generates the next window into the ready buffer */
+static int generateWindow()
+{
+  double rate = totalRate();
+  if ( !(rate > 0.) ) {
+    return TDC_NotEnabled;
+  }
+  ensurePool();
+  const Int64 begin = gen.time;
+  const Int64 width = std::max( (Int64) 1, (Int64) std::min( WINDOW_EVENTS * 1.e12 / rate,
+                                                             (double) MAX_WINDOW ) );
+  const Int64 end   = begin + width;
+
+  gen.taskCount = 0;
+  if ( gen.syncChan ) {
+    addSlices( gen.syncChan - 1, true, 1.e12 / gen.period, begin, width );
+  }
+  for ( Int32 i = 0; i < CHANNELS; ++i ) {
+    const Channel & c = gen.ch[i];
+    if ( c.model == GEN_OFF ) {
+      continue;
+    }
+    if ( memoryless( c.model ) ) {
+      addSlices( i, false, channelRate( c ), begin, width );
+    }
+    else {
+      addTask( i, false, begin, end, Random::mix( gen.seed + 2 * CHANNELS + i ) );
+    }
+  }
+  gen.pool ->run( gen.taskCount, []( int i ) { runTask( gen.tasks[i] ); } );
+
+  /* The lists are sorted; their events beyond the window are tails
+   * that become pending.
+   */
+  std::vector<std::vector<Event> *> & lists = gen.lists;
+  lists.assign( 1, &gen.pending );
+  for ( Int32 i = 0; i < gen.taskCount; ++i ) {
+    lists.push_back( &gen.tasks[i].events );
+  }
+  gen.inWindow.resize( lists.size() );
+  gen.nextPending.clear();
+  for ( size_t l = 0; l < lists.size(); ++l ) {
+    auto tail = std::lower_bound( lists[l] ->begin(), lists[l] ->end(), end, beforeTime );
+    gen.inWindow[l] = (Int32) (tail - lists[l] ->begin());
+    gen.nextPending.insert( gen.nextPending.end(), tail, lists[l] ->end() );
+  }
+  std::sort( gen.nextPending.begin(), gen.nextPending.end(), earlier );
+
+  /* The window is cut into groups of equal duration that are merged
+   * in parallel.
+   */
+  int groups = gen.pool ->threads() * 4;
+  gen.groups.resize( groups );
+  gen.pool ->run( groups, [&]( int g ) {
+    Group & gr = gen.groups[g];
+    gr.begin = begin + width * g / groups;
+    gr.end   = begin + width * (g + 1) / groups;
+    gr.lo.resize( lists.size() );
+    gr.hi.resize( lists.size() );
+    gr.count = 0;
+    for ( size_t l = 0; l < lists.size(); ++l ) {
+      Event * first = lists[l] ->data();
+      Event * last  = first + gen.inWindow[l];
+      gr.lo[l]  = (Int32) (std::lower_bound( first, last, gr.begin, beforeTime ) - first);
+      gr.hi[l]  = (Int32) (std::lower_bound( first, last, gr.end, beforeTime ) - first);
+      gr.count += gr.hi[l] - gr.lo[l];
+    }
+  } );
+  Int32 total = 0;
+  for ( Group & gr : gen.groups ) {
+    gr.offset = total;
+    total    += gr.count;
+  }
+  gen.readyTs.resize( total );
+  gen.readyCh.resize( total );
+  gen.readyPos = 0;
+  gen.pool ->run( groups, [&]( int g ) {
+    mergeGroup( gen.groups[g], lists );
+  } );
+  gen.pending.swap( gen.nextPending );
+
+  gen.time = end;
+  gen.window++;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setGenChannel( Int32          channel,
+                              TDC_GenModel   model,
+                              const double * par )
+{
+  if ( channel < 1 || channel > CHANNELS || (model != GEN_OFF && !par) ) {
+    return TDC_OutOfRange;
+  }
+  double p[TDC_GEN_PARAMS] = { 0., 0., 0., 0. };
+  if ( par ) {
+    std::copy( par, par + TDC_GEN_PARAMS, p );
+  }
+  if ( !validParams( model, p ) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( gen.lock );
+  Channel & c = gen.ch[channel - 1];
+  c.model = model;
+  std::copy( p, p + TDC_GEN_PARAMS, c.par );
+  c.init  = true;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getGenChannel( Int32          channel,
+                              TDC_GenModel * model,
+                              double       * par )
+{
+  if ( channel < 1 || channel > CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( gen.lock );
+  const Channel & c = gen.ch[channel - 1];
+  if ( model ) {
+    *model = c.model;
+  }
+  if ( par ) {
+    std::copy( c.par, c.par + TDC_GEN_PARAMS, par );
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setGenLaser( Int32 period,
+                            Int32 syncChan )
+{
+  if ( period < 1 || period > 1000000000 || syncChan < 0 || syncChan > CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( gen.lock );
+  gen.period   = period;
+  gen.syncChan = syncChan;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getGenLaser( Int32 * period,
+                            Int32 * syncChan )
+{
+  std::lock_guard<std::mutex> guard( gen.lock );
+  if ( period ) {
+    *period = gen.period;
+  }
+  if ( syncChan ) {
+    *syncChan = gen.syncChan;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setGenThreads( Int32 threads )
+{
+  if ( threads < 0 || threads > 256 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( gen.lock );
+  gen.threads = threads;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_resetGen( Int64 seed )
+{
+  std::lock_guard<std::mutex> guard( gen.lock );
+  gen.seed   = (uint64_t) seed;
+  gen.time   = 0;
+  gen.window = 0;
+  gen.events = 0;
+  for ( Channel & c : gen.ch ) {
+    c.init    = true;
+    c.counter = 0;
+  }
+  gen.pending.clear();
+  gen.readyTs.clear();
+  gen.readyCh.clear();
+  gen.readyPos = 0;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_genTimestamps( Int64 * timestamps,
+                              Uint8 * channels,
+                              Int32   size,
+                              Int32 * count )
+{
+  if ( size < 0 || (size && (!timestamps || !channels)) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( gen.lock );
+  Int32 done = 0;
+  int   rc   = TDC_Ok;
+  while ( done < size ) {
+    if ( gen.readyPos == gen.readyTs.size() && (rc = generateWindow()) != TDC_Ok ) {
+      break;
+    }
+    size_t n = std::min( (size_t) (size - done), gen.readyTs.size() - gen.readyPos );
+    std::copy( gen.readyTs.begin() + gen.readyPos, gen.readyTs.begin() + gen.readyPos + n,
+               timestamps + done );
+    std::copy( gen.readyCh.begin() + gen.readyPos, gen.readyCh.begin() + gen.readyPos + n,
+               channels + done );
+    gen.readyPos += n;
+    done         += (Int32) n;
+  }
+  gen.events += done;
+  if ( count ) {
+    *count = done;
+  }
+  return rc;
+}
+
+
+int TDC_CC TDC_genInputTimestamps( Int64 count )
+{
+  if ( count < 0 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( gen.lock );
+  while ( count > 0 ) {
+    if ( gen.readyPos == gen.readyTs.size() ) {
+      int rc = generateWindow();
+      if ( rc != TDC_Ok ) {
+        return rc;
+      }
+      continue;
+    }
+    Int32 n = (Int32) std::min( (size_t) count, gen.readyTs.size() - gen.readyPos );
+    int rc = TDC_inputTimestamps( gen.readyTs.data() + gen.readyPos,
+                                  gen.readyCh.data() + gen.readyPos, n );
+    if ( rc != TDC_Ok ) {
+      return rc;
+    }
+    gen.readyPos += n;
+    gen.events   += n;
+    count        -= n;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getGenInfo( Int64  * time,
+                           Int64  * events,
+                           double * rate )
+{
+  std::lock_guard<std::mutex> guard( gen.lock );
+  if ( time ) {
+    *time = gen.time;
+  }
+  if ( events ) {
+    *events = gen.events;
+  }
+  if ( rate ) {
+    *rate = totalRate();
+  }
+  return TDC_Ok;
+}
@@ -0,0 +1,521 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdchg2tcp.cpp
+ *
+ *  Purpose:        Sparse triple coincidence map for heralded g(2)
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdchg2tcp.h"
+#include "tdcwindow.h"
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+/* A triple is counted when the later of its two signal events arrives;
+ * all idlers it refers to have arrived before. The tiles of a map live
+ * in one pool, the map from the tile key (row * tilesPerAxis + column)
+ * to the pool index is only consulted when an event leaves the last
+ * tile used.
+ *
+ * There is one event window per channel, shared by all configurations
+ * using the channel. A window is trimmed when an event is pushed; stale
+ * entries of the other windows are never reached by the loops.
+ */
+
+#define CHANNELS     32
+#define MAX_CONFIGS  256
+
+namespace {
+
+struct TileMap {
+  std::unordered_map<Int64, Int32> index;
+  std::vector<Int64> keys;          /* Key of every tile */
+  std::vector<Int64> pool;          /* Tile data */
+  Int64       lastKey  = -1;
+  Int64     * lastTile = 0;
+};
+
+struct Config {
+  Int32       idler;                /* Channels 0...31 */
+  Int32       signal1;
+  Int32       signal2;
+  TileMap     map;
+  std::vector<Int64> hist1;         /* Delays idler - signal 1 */
+  std::vector<Int64> hist2;         /* Delays idler - signal 2 */
+  Int64       evtIdler = 0;
+  Int64       triples  = 0;
+};
+
+struct Hg2Tcp {
+  std::mutex  lock;
+  bool        enabled  = false;
+  Int32       binWidth = 100;
+  Int32       binCount = 256;
+  Int32       tileSize = 32;
+  Int32       tileBits = 5;
+  std::vector<Config> configs;
+  std::vector<Int32>  asIdler[CHANNELS];      /* Config indices per role */
+  std::vector<Int32>  asSignal1[CHANNELS];
+  std::vector<Int32>  asSignal2[CHANNELS];
+  EventWindow window[CHANNELS];
+};
+
+Hg2Tcp tcp;
+
+}
+
+
+static void clearConfig( Config & cfg )
+{
+  cfg.map.index.clear();
+  std::vector<Int64>().swap( cfg.map.keys );
+  std::vector<Int64>().swap( cfg.map.pool );
+  cfg.map.lastKey  = -1;
+  cfg.map.lastTile = 0;
+  cfg.hist1.assign( tcp.binCount, 0 );
+  cfg.hist2.assign( tcp.binCount, 0 );
+  cfg.evtIdler = 0;
+  cfg.triples  = 0;
+}
+
+
+static void clearData()
+{
+  for ( int i = 0; i < CHANNELS; ++i ) {
+    tcp.window[i].clear();
+  }
+  for ( auto & cfg : tcp.configs ) {
+    clearConfig( cfg );
+  }
+}
+
+
+static void releaseData()
+{
+  for ( int i = 0; i < CHANNELS; ++i ) {
+    tcp.window[i] = EventWindow();
+  }
+  for ( auto & cfg : tcp.configs ) {
+    clearConfig( cfg );
+    std::unordered_map<Int64, Int32>().swap( cfg.map.index );
+    std::vector<Int64>().swap( cfg.hist1 );
+    std::vector<Int64>().swap( cfg.hist2 );
+  }
+}
+
+
+static void buildRoles()
+{
+  for ( int i = 0; i < CHANNELS; ++i ) {
+    tcp.asIdler[i].clear();
+    tcp.asSignal1[i].clear();
+    tcp.asSignal2[i].clear();
+  }
+  for ( Int32 c = 0; c < (Int32) tcp.configs.size(); ++c ) {
+    tcp.asIdler[tcp.configs[c].idler].push_back( c );
+    tcp.asSignal1[tcp.configs[c].signal1].push_back( c );
+    tcp.asSignal2[tcp.configs[c].signal2].push_back( c );
+  }
+}
+
+
+static Int64 * tile( TileMap & map, Int64 key )
+{
+  const Int32 area = 2 * tcp.tileBits;
+  auto it = map.index.find( key );
+  if ( it != map.index.end() ) {
+    return map.pool.data() + ((size_t) it ->second << area);
+  }
+  Int32 idx = (Int32) map.keys.size();
+  map.index.emplace( key, idx );
+  map.keys.push_back( key );
+  map.pool.resize( map.pool.size() + ((size_t) 1 << area), 0 );
+  return map.pool.data() + ((size_t) idx << area);
+}
+
+
+static void count( Config & cfg, Int64 bin1, Int64 bin2 )
+{
+  const Int32 bits = tcp.tileBits;
+  const Int32 mask = tcp.tileSize - 1;
+  TileMap & map = cfg.map;
+  Int64 key = (bin2 >> bits) * ((tcp.binCount + mask) >> bits) + (bin1 >> bits);
+  if ( key != map.lastKey ) {
+    map.lastTile = tile( map, key );
+    map.lastKey  = key;
+  }
+  map.lastTile[(bin1 & mask) + ((bin2 & mask) << bits)]++;
+  cfg.triples++;
+}
+
+
+/* Counts the coincidences of a new signal event of a configuration;
+ * first tells if the new event is signal 1.
+ */
+static void processSignal( Config & cfg, Int64 time, bool first )
+{
+  const Int64 range = (Int64) tcp.binWidth * tcp.binCount;
+  const EventWindow & idlers = tcp.window[cfg.idler];
+  const EventWindow & other  = tcp.window[first ? cfg.signal2 : cfg.signal1];
+  Int64 * hist = (first ? cfg.hist1 : cfg.hist2).data();
+
+  for ( Int32 i = 0; i < idlers.size(); ++i ) {
+    Int64 ti = idlers.back( i );
+    Int64 d  = time - ti;
+    if ( d >= range ) {
+      break;
+    }
+    if ( d < 0 ) {
+      continue;
+    }
+    hist[d / tcp.binWidth]++;
+    for ( Int32 j = 0; j < other.size(); ++j ) {
+      Int64 e = other.back( j ) - ti;
+      if ( e < 0 ) {
+        break;
+      }
+      if ( e >= range ) {
+        continue;
+      }
+      if ( first ) {
+        count( cfg, d / tcp.binWidth, e / tcp.binWidth );
+      }
+      else {
+        count( cfg, e / tcp.binWidth, d / tcp.binWidth );
+      }
+    }
+  }
+}
+
+
+static void processEvents( const Int64 * timestamps, const Uint8 * channels, Int32 count )
+{
+  const Int64 range = (Int64) tcp.binWidth * tcp.binCount;
+
+  for ( Int32 i = 0; i < count; ++i ) {
+    int   ch   = channels[i];
+    Int64 time = timestamps[i];
+    if ( ch >= CHANNELS ) {
+      continue;
+    }
+    const std::vector<Int32> & idl = tcp.asIdler[ch];
+    const std::vector<Int32> & s1  = tcp.asSignal1[ch];
+    const std::vector<Int32> & s2  = tcp.asSignal2[ch];
+    if ( idl.empty() && s1.empty() && s2.empty() ) {
+      continue;
+    }
+    for ( Int32 c : idl ) {
+      tcp.configs[c].evtIdler++;
+    }
+    for ( Int32 c : s1 ) {
+      processSignal( tcp.configs[c], time, true );
+    }
+    for ( Int32 c : s2 ) {
+      processSignal( tcp.configs[c], time, false );
+    }
+    tcp.window[ch].push( time );
+    tcp.window[ch].dropBefore( time - range );
+  }
+}
+
+
+int TDC_CC TDC_enableHg2Tcp( Bln32 enable )
+{
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  tcp.enabled = enable != 0;
+  if ( tcp.enabled ) {
+    clearData();
+  }
+  else {
+    releaseData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setHg2TcpParams( Int32 binWidth,
+                                Int32 binCount,
+                                Int32 tileSize )
+{
+  int bits = 3;
+  while ( bits < 8 && (1 << bits) != tileSize ) {
+    ++bits;
+  }
+  if ( binWidth < 1 || binWidth > 1000000 || binCount < 16 || binCount > 65536 ||
+       (1 << bits) != tileSize ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  tcp.binWidth = binWidth;
+  tcp.binCount = binCount;
+  tcp.tileSize = tileSize;
+  tcp.tileBits = bits;
+  if ( tcp.enabled ) {
+    clearData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getHg2TcpParams( Int32 * binWidth,
+                                Int32 * binCount,
+                                Int32 * tileSize )
+{
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  if ( binWidth ) {
+    *binWidth = tcp.binWidth;
+  }
+  if ( binCount ) {
+    *binCount = tcp.binCount;
+  }
+  if ( tileSize ) {
+    *tileSize = tcp.tileSize;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addHg2TcpConfig( Int32   idler,
+                                Int32   channel1,
+                                Int32   channel2,
+                                Int32 * config )
+{
+  if ( idler < 1 || idler > CHANNELS || channel1 < 1 || channel1 > CHANNELS ||
+       channel2 < 1 || channel2 > CHANNELS ||
+       idler == channel1 || idler == channel2 || channel1 == channel2 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  if ( tcp.configs.size() >= MAX_CONFIGS ) {
+    return TDC_OutOfRange;
+  }
+  Config cfg;
+  cfg.idler   = idler - 1;
+  cfg.signal1 = channel1 - 1;
+  cfg.signal2 = channel2 - 1;
+  tcp.configs.push_back( std::move( cfg ) );
+  buildRoles();
+  if ( tcp.enabled ) {
+    clearData();
+  }
+  if ( config ) {
+    *config = (Int32) tcp.configs.size() - 1;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_clearHg2TcpConfigs( void )
+{
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  std::vector<Config>().swap( tcp.configs );
+  buildRoles();
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getHg2TcpConfig( Int32   config,
+                                Int32 * idler,
+                                Int32 * channel1,
+                                Int32 * channel2 )
+{
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  if ( config < 0 || config >= (Int32) tcp.configs.size() ) {
+    return TDC_OutOfRange;
+  }
+  const Config & cfg = tcp.configs[config];
+  if ( idler ) {
+    *idler = cfg.idler + 1;
+  }
+  if ( channel1 ) {
+    *channel1 = cfg.signal1 + 1;
+  }
+  if ( channel2 ) {
+    *channel2 = cfg.signal2 + 1;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getHg2TcpConfigCount( Int32 * count )
+{
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  if ( count ) {
+    *count = (Int32) tcp.configs.size();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_resetHg2Tcp( void )
+{
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  if ( !tcp.enabled ) {
+    return TDC_NotEnabled;
+  }
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addHg2TcpTimestamps( const Int64 * timestamps,
+                                    const Uint8 * channels,
+                                    Int32         count )
+{
+  if ( count < 0 || (count && (!timestamps || !channels)) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  if ( !tcp.enabled ) {
+    return TDC_NotEnabled;
+  }
+  processEvents( timestamps, channels, count );
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getHg2TcpInfo( Int32   config,
+                              Int32 * tiles,
+                              Int64 * evtIdler,
+                              Int64 * coinc1,
+                              Int64 * coinc2,
+                              Int64 * triples )
+{
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  if ( config < 0 || config >= (Int32) tcp.configs.size() ) {
+    return TDC_OutOfRange;
+  }
+  if ( !tcp.enabled ) {
+    return TDC_NotEnabled;
+  }
+  const Config & cfg = tcp.configs[config];
+  if ( tiles ) {
+    *tiles = (Int32) cfg.map.keys.size();
+  }
+  if ( evtIdler ) {
+    *evtIdler = cfg.evtIdler;
+  }
+  if ( coinc1 ) {
+    *coinc1 = 0;
+    for ( Int64 h : cfg.hist1 ) {
+      *coinc1 += h;
+    }
+  }
+  if ( coinc2 ) {
+    *coinc2 = 0;
+    for ( Int64 h : cfg.hist2 ) {
+      *coinc2 += h;
+    }
+  }
+  if ( triples ) {
+    *triples = cfg.triples;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getHg2TcpG2( Int32    config,
+                            Int32    window,
+                            double * g2 )
+{
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  if ( config < 0 || config >= (Int32) tcp.configs.size() ||
+       window < 1 || window > tcp.binCount ) {
+    return TDC_OutOfRange;
+  }
+  if ( !tcp.enabled ) {
+    return TDC_NotEnabled;
+  }
+  const Config & cfg = tcp.configs[config];
+  Int64 coinc1 = 0, coinc2 = 0, triples = 0;
+  for ( Int32 i = 0; i < window; ++i ) {
+    coinc1 += cfg.hist1[i];
+    coinc2 += cfg.hist2[i];
+  }
+
+  const Int32  perAxis  = (tcp.binCount + tcp.tileSize - 1) / tcp.tileSize;
+  const Int32  size     = tcp.tileSize;
+  for ( size_t t = 0; t < cfg.map.keys.size(); ++t ) {
+    Int32 bin1 = (Int32) (cfg.map.keys[t] % perAxis) * size;
+    Int32 bin2 = (Int32) (cfg.map.keys[t] / perAxis) * size;
+    if ( bin1 >= window || bin2 >= window ) {
+      continue;
+    }
+    const Int64 * data = cfg.map.pool.data() + t * size * size;
+    Int32 n1 = std::min( size, window - bin1 );
+    Int32 n2 = std::min( size, window - bin2 );
+    for ( Int32 b = 0; b < n2; ++b ) {
+      for ( Int32 a = 0; a < n1; ++a ) {
+        triples += data[a + b * size];
+      }
+    }
+  }
+
+  if ( !coinc1 || !coinc2 ) {
+    return TDC_NotAvailable;
+  }
+  if ( g2 ) {
+    *g2 = (double) cfg.evtIdler * triples / ((double) coinc1 * coinc2);
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getHg2TcpTiles( Int32         config,
+                               TDC_Hg2Tile * tiles,
+                               Int64       * buffer,
+                               Int32       * count,
+                               Bln32         reset )
+{
+  if ( (tiles || buffer) && !count ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( tcp.lock );
+  if ( config < 0 || config >= (Int32) tcp.configs.size() ) {
+    return TDC_OutOfRange;
+  }
+  if ( !tcp.enabled ) {
+    return TDC_NotEnabled;
+  }
+  Config & cfg = tcp.configs[config];
+  const std::vector<Int64> & keys = cfg.map.keys;
+  Int32 n = (Int32) keys.size();
+  if ( (tiles || buffer) && *count < n ) {
+    *count = n;
+    return TDC_OutOfRange;
+  }
+  if ( count ) {
+    *count = n;
+  }
+
+  std::vector<Int32> order( n );
+  for ( Int32 i = 0; i < n; ++i ) {
+    order[i] = i;
+  }
+  std::sort( order.begin(), order.end(),
+             [&keys]( Int32 a, Int32 b ) { return keys[a] < keys[b]; } );
+
+  const Int32  perAxis  = (tcp.binCount + tcp.tileSize - 1) / tcp.tileSize;
+  const size_t tileArea = (size_t) tcp.tileSize * tcp.tileSize;
+  for ( Int32 i = 0; i < n; ++i ) {
+    Int64 key = keys[order[i]];
+    if ( tiles ) {
+      tiles[i].bin1 = (Int32) (key % perAxis) * tcp.tileSize;
+      tiles[i].bin2 = (Int32) (key / perAxis) * tcp.tileSize;
+    }
+    if ( buffer ) {
+      const Int64 * src = cfg.map.pool.data() + order[i] * tileArea;
+      std::copy( src, src + tileArea, buffer + i * tileArea );
+    }
+  }
+  if ( reset ) {
+    clearConfig( cfg );
+  }
+  return TDC_Ok;
+}
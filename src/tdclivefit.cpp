@@ -0,0 +1,338 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdclivefit.cpp
+ *
+ *  Purpose:        Background fitting during accumulation
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdclivefit.h"
+#include "tdcfitcore.h"
+#include "tdcfitmodel.h"
+#include "tdcdevhandle.h"
+#include "tdcbase.h"
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <algorithm>
+
+/* The fit runs without holding the lock. Every change of the data source
+ * or the start values increments the generation; a fit that was started
+ * with an older generation is not published.
+ *
+ * The data are retrieved with the device addressed like a call of the
+ * device handle API, the global device under the address lock. The fetch
+ * lock is held meanwhile, so a device that has been deselected is not
+ * accessed anymore.
+ */
+
+#define PARAM_SIZE  (HBT_PARAM_SIZE > LFT_PARAM_SIZE ? HBT_PARAM_SIZE : LFT_PARAM_SIZE)
+
+namespace {
+
+struct LiveFit {
+  std::mutex              control;   /* Serializes start and stop */
+  std::mutex              lock;
+  std::mutex              fetch;     /* Held while data are retrieved */
+  std::condition_variable wake;
+  TDC_Device * device    = 0;          /* Protected by fetch; 0: global */
+  std::thread             thread;
+  bool        enabled    = false;
+  bool        quit       = false;
+  bool        kick       = false;      /* Fit now, don't wait */
+  Int32       interval   = 1000;
+  bool        hbt        = true;       /* Data source */
+  int         fitType    = FCTTYPE_THERMAL;
+  Int32       channel    = 0;
+  double      start[PARAM_SIZE] = { 0. };
+  unsigned    generation = 0;
+  /* Result */
+  bool          valid    = false;
+  Int32         sequence = 0;
+  Int64         events   = -1;         /* Event count of the last fit */
+  double        params[PARAM_SIZE] = { 0. };
+  double        errors[PARAM_SIZE] = { 0. };
+  TDC_FitResult result   = { 0, 0, 0. };
+
+  ~LiveFit();
+};
+
+LiveFit lf;
+
+}
+
+
+/* Calls f with the selected device addressed */
+template <class F>
+static bool withDevice( F f )
+{
+  std::lock_guard<std::mutex> fetch( lf.fetch );
+  if ( lf.device ) {
+    DeviceScope scope( lf.device );
+    return scope.error() == TDC_Ok && f();
+  }
+  std::lock_guard<std::mutex> addr( deviceAddressLock() );
+  return f();
+}
+
+
+/* Retrieves the current data and fits it; returns false if there is
+ * nothing new to fit. events: In: count of the last fit, Out: current count
+ */
+static bool fitCurrent( bool hbt, int fitType, Int32 channel, double * par,
+                        double * errors, TDC_FitResult & result, Int64 & events )
+{
+  double timebase;
+  if ( hbt ) {
+    Int64  total = 0;
+    double jitter = 0.;
+    TDC_HbtFunction * fct = 0;
+    bool ok = withDevice( [&] {
+      if ( TDC_getTimebase( &timebase ) != TDC_Ok ) {
+        return false;
+      }
+      TDC_getHbtEventCount( &total, 0, 0 );
+      if ( total == 0 || total == events ) {
+        return false;
+      }
+      TDC_getHbtDetectorParams( &jitter );
+      fct = TDC_createHbtFunction();
+      return fct && TDC_calcHbtG2( fct ) == TDC_Ok;
+    } );
+    ok = ok && fct ->size >= modelHbtParamCount( (HBT_FctType) fitType );
+    if ( ok ) {
+      fitHbtFunction( fct, (HBT_FctType) fitType, timebase, jitter, par, result, errors );
+      events = total;
+    }
+    TDC_releaseHbtFunction( fct );
+    return ok;
+  }
+
+  Int32 startEvts = 0, stopEvts = 0;
+  LftSetup setup = currentLftSetup();
+  TDC_LftFunction * fct = 0;
+  bool ok = withDevice( [&] {
+    if ( TDC_getTimebase( &timebase ) != TDC_Ok ) {
+      return false;
+    }
+    fct = TDC_createLftFunction();
+    return fct && TDC_getLftHistogram( channel, 0, fct, 0, &startEvts, &stopEvts, 0 ) == TDC_Ok;
+  } );
+  setup.timebase = timebase;
+  ok = ok && stopEvts > 0 && stopEvts != events &&
+       (!setup.irf || fct ->binWidth == setup.irfBinWidth) &&
+       fct ->size >= modelLftParamCount( (LFT_FctType) fitType );
+  if ( ok ) {
+    fitLftFunction( fct, (LFT_FctType) fitType, setup, par, result, errors );
+    events = stopEvts;
+  }
+  TDC_releaseLftFunction( fct );
+  return ok;
+}
+
+
+static void worker()
+{
+  std::unique_lock<std::mutex> guard( lf.lock );
+  while ( !lf.quit ) {
+    bool     hbt        = lf.hbt;
+    int      fitType    = lf.fitType;
+    Int32    channel    = lf.channel;
+    unsigned generation = lf.generation;
+    Int64    events     = lf.events;
+    double   par[PARAM_SIZE], errors[PARAM_SIZE] = { 0. };
+    std::copy( lf.valid ? lf.params : lf.start, (lf.valid ? lf.params : lf.start) + PARAM_SIZE, par );
+    guard.unlock();
+
+    TDC_FitResult result;
+    bool fitted = fitCurrent( hbt, fitType, channel, par, errors, result, events );
+
+    guard.lock();
+    if ( fitted && generation == lf.generation && result.iterations >= 0 ) {
+      std::copy( par, par + PARAM_SIZE, lf.params );
+      std::copy( errors, errors + PARAM_SIZE, lf.errors );
+      lf.result = result;
+      lf.events = events;
+      lf.valid  = true;
+      lf.sequence++;
+    }
+    lf.wake.wait_for( guard, std::chrono::milliseconds( lf.interval ),
+                      [] { return lf.quit || lf.kick; } );
+    lf.kick = false;
+  }
+}
+
+
+/* Discards the result; requires the lock */
+static void discard()
+{
+  lf.generation++;
+  lf.valid    = false;
+  lf.sequence = 0;
+  lf.events   = -1;
+  lf.kick     = true;
+  lf.wake.notify_all();
+}
+
+
+static void stopThread()
+{
+  {
+    std::lock_guard<std::mutex> guard( lf.lock );
+    lf.quit = true;
+  }
+  lf.wake.notify_all();
+  if ( lf.thread.joinable() ) {
+    lf.thread.join();
+  }
+}
+
+
+LiveFit::~LiveFit()
+{
+  if ( thread.joinable() ) {
+    stopThread();
+  }
+}
+
+
+int TDC_CC TDC_enableLiveFit( Bln32 enable )
+{
+  std::lock_guard<std::mutex> control( lf.control );
+  std::unique_lock<std::mutex> guard( lf.lock );
+  if ( !enable == !lf.enabled ) {
+    return TDC_Ok;
+  }
+  lf.enabled = enable;
+  if ( enable ) {
+    discard();
+    lf.quit   = false;
+    lf.thread = std::thread( worker );
+  }
+  else {
+    guard.unlock();
+    stopThread();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setLiveFitHbt( HBT_FctType    fitType,
+                              const double * startParams )
+{
+  if ( modelHbtParamCount( fitType ) < 0 ) {
+    return TDC_OutOfRange;
+  }
+  double defaults[HBT_PARAM_SIZE] = { 0. };
+  if ( !startParams ) {
+    TDC_getHbtFitStartParams( fitType, defaults );
+    startParams = defaults;
+  }
+  std::lock_guard<std::mutex> guard( lf.lock );
+  lf.hbt     = true;
+  lf.fitType = fitType;
+  std::fill( lf.start, lf.start + PARAM_SIZE, 0. );
+  std::copy( startParams, startParams + HBT_PARAM_SIZE, lf.start );
+  discard();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setLiveFitLft( Int32          channel,
+                              LFT_FctType    fitType,
+                              const double * startParams )
+{
+  if ( channel < 0 || channel > TDC_QUTAG_CHANNELS ||
+       modelLftParamCount( fitType ) < 0 || !startParams ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( lf.lock );
+  lf.hbt     = false;
+  lf.fitType = fitType;
+  lf.channel = channel;
+  std::fill( lf.start, lf.start + PARAM_SIZE, 0. );
+  std::copy( startParams, startParams + LFT_PARAM_SIZE, lf.start );
+  discard();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setLiveFitDevice( TDC_Device * dev )
+{
+  {
+    std::lock_guard<std::mutex> fetch( lf.fetch );
+    lf.device = dev;
+  }
+  std::lock_guard<std::mutex> guard( lf.lock );
+  discard();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getLiveFitDevice( TDC_Device ** dev )
+{
+  std::lock_guard<std::mutex> fetch( lf.fetch );
+  if ( dev ) {
+    *dev = lf.device;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setLiveFitInterval( Int32 interval )
+{
+  if ( interval < 10 || interval > 60000 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( lf.lock );
+  lf.interval = interval;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getLiveFitInterval( Int32 * interval )
+{
+  std::lock_guard<std::mutex> guard( lf.lock );
+  if ( interval ) {
+    *interval = lf.interval;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_resetLiveFit( void )
+{
+  std::lock_guard<std::mutex> guard( lf.lock );
+  discard();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getLiveFitResult( double        * fitParams,
+                                 double        * errors,
+                                 TDC_FitResult * result,
+                                 Int32         * sequence )
+{
+  std::lock_guard<std::mutex> guard( lf.lock );
+  if ( !lf.valid ) {
+    return TDC_NotAvailable;
+  }
+  int size = lf.hbt ? HBT_PARAM_SIZE : LFT_PARAM_SIZE;
+  if ( fitParams ) {
+    std::copy( lf.params, lf.params + size, fitParams );
+  }
+  if ( errors ) {
+    std::copy( lf.errors, lf.errors + size, errors );
+  }
+  if ( result ) {
+    *result = lf.result;
+  }
+  if ( sequence ) {
+    *sequence = lf.sequence;
+  }
+  return TDC_Ok;
+}
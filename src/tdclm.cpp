@@ -0,0 +1,244 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdclm.cpp
+ *
+ *  Purpose:        Levenberg-Marquardt least squares solver
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdclm.h"
+#include <cmath>
+#include <cfloat>
+#include <vector>
+
+/* Marquardt's scaled damping with the gain ratio update of Nielsen.
+ * The normal equations are at most LM_MAX_PAR x LM_MAX_PAR and solved
+ * by Cholesky decomposition. Without a Jacobian callback the Jacobian
+ * is approximated by forward differences.
+ */
+
+
+/* Solve (A + mu diag(A)) x = g; returns false if not positive definite */
+static bool solveDamped( int n, const double * a, const double * g, double mu, double * x )
+{
+  double l[LM_MAX_PAR * LM_MAX_PAR];
+  for ( int i = 0; i < n; ++i ) {
+    for ( int j = 0; j <= i; ++j ) {
+      double s = a[i * n + j];
+      if ( i == j ) {
+        s += mu * (a[i * n + i] > DBL_MIN ? a[i * n + i] : 1.);
+      }
+      for ( int k = 0; k < j; ++k ) {
+        s -= l[i * n + k] * l[j * n + k];
+      }
+      if ( i == j ) {
+        if ( !(s > 0.) ) {
+          return false;
+        }
+        l[i * n + i] = sqrt( s );
+      }
+      else {
+        l[i * n + j] = s / l[j * n + j];
+      }
+    }
+  }
+  for ( int i = 0; i < n; ++i ) {
+    double s = g[i];
+    for ( int k = 0; k < i; ++k ) {
+      s -= l[i * n + k] * x[k];
+    }
+    x[i] = s / l[i * n + i];
+  }
+  for ( int i = n - 1; i >= 0; --i ) {
+    double s = x[i];
+    for ( int k = i + 1; k < n; ++k ) {
+      s -= l[k * n + i] * x[k];
+    }
+    x[i] = s / l[i * n + i];
+  }
+  return true;
+}
+
+
+/* Objective: sum of squares or Poisson deviance
+ * 2 sum( f - y + y ln(y/f) ); the deviance is infinite for f <= 0
+ * except for empty bins where f = 0
+ */
+static double objective( bool poisson, int n, const double * y, const double * f )
+{
+  double s = 0.;
+  if ( poisson ) {
+    for ( int i = 0; i < n; ++i ) {
+      if ( !(f[i] > 0.) ) {
+        if ( f[i] == 0. && y[i] == 0. ) {
+          continue;
+        }
+        return HUGE_VAL;
+      }
+      s += f[i] - y[i] + (y[i] > 0. ? y[i] * log( y[i] / f[i] ) : 0.);
+    }
+    return 2. * s;
+  }
+  for ( int i = 0; i < n; ++i ) {
+    double r = y[i] - f[i];
+    s += r * r;
+  }
+  return s;
+}
+
+
+/* Jacobian at par; f holds the model values at par */
+static void calcJacobian( int nPar, double * par, int nData, const double * f,
+                          LmModel model, LmJacobian jacobian, void * user,
+                          double * jac, LmResult & result )
+{
+  if ( jacobian ) {
+    jacobian( par, jac, user );
+    result.evaluations++;
+    return;
+  }
+  for ( int j = 0; j < nPar; ++j ) {
+    double h = 1.5e-8 * (fabs( par[j] ) > DBL_MIN ? fabs( par[j] ) : 1.);
+    double save = par[j];
+    double * jj = jac + (size_t) j * nData;
+    par[j] += h;
+    model( par, jj, user );
+    par[j] = save;
+    for ( int i = 0; i < nData; ++i ) {
+      jj[i] = (jj[i] - f[i]) / h;
+    }
+  }
+  result.evaluations += nPar;
+}
+
+
+/* Normal equations a = J^T W J, g = J^T W (y - f); the weights W are 1
+ * for least squares and 1/f for the Poisson deviance (Fisher scoring)
+ */
+static void normalEquations( bool poisson, int nPar, int nData, const double * jac,
+                             const double * y, const double * f,
+                             double * w, double * a, double * g )
+{
+  for ( int i = 0; i < nData; ++i ) {
+    w[i] = !poisson ? 1. : (f[i] > 0. ? 1. / f[i] : 0.);
+  }
+  for ( int j = 0; j < nPar; ++j ) {
+    const double * jj = jac + (size_t) j * nData;
+    double s = 0.;
+    for ( int i = 0; i < nData; ++i ) {
+      s += jj[i] * w[i] * (y[i] - f[i]);
+    }
+    g[j] = s;
+    for ( int k = 0; k <= j; ++k ) {
+      const double * jk = jac + (size_t) k * nData;
+      double t = 0.;
+      for ( int i = 0; i < nData; ++i ) {
+        t += jj[i] * w[i] * jk[i];
+      }
+      a[j * nPar + k] = a[k * nPar + j] = t;
+    }
+  }
+}
+
+
+void lmFit( int              nPar,
+            double         * par,
+            int              nData,
+            const double   * y,
+            LmModel          model,
+            LmJacobian       jacobian,
+            void           * user,
+            const LmControl & ctl,
+            LmResult       & result )
+{
+  std::vector<double> f( nData ), fNew( nData ), w( nData ), jac( (size_t) nPar * nData );
+  double a[LM_MAX_PAR * LM_MAX_PAR], g[LM_MAX_PAR], step[LM_MAX_PAR], pNew[LM_MAX_PAR];
+  double mu = 1e-3, nu = 2.;
+  bool   newJacobian = true;
+
+  result = LmResult();
+  if ( nPar < 1 || nPar > LM_MAX_PAR || nData < nPar ) {
+    result.iterations = -1;
+    return;
+  }
+
+  model( par, f.data(), user );
+  result.evaluations++;
+  double ss = objective( ctl.poisson, nData, y, f.data() );
+  if ( !std::isfinite( ss ) ) {
+    result.iterations = -1;
+    return;
+  }
+
+  while ( result.iterations < ctl.maxIter ) {
+    if ( newJacobian ) {
+      calcJacobian( nPar, par, nData, f.data(), model, jacobian, user, jac.data(), result );
+      normalEquations( ctl.poisson, nPar, nData, jac.data(), y, f.data(), w.data(), a, g );
+      newJacobian = false;
+    }
+
+    result.iterations++;
+    if ( !solveDamped( nPar, a, g, mu, step ) ) {
+      mu *= nu;
+      nu *= 2.;
+      continue;
+    }
+
+    double stepNorm = 0., parNorm = 0., predicted = 0.;
+    for ( int j = 0; j < nPar; ++j ) {
+      pNew[j]    = par[j] + step[j];
+      stepNorm  += step[j] * step[j];
+      parNorm   += par[j] * par[j];
+      predicted += step[j] * (mu * (a[j * nPar + j] > DBL_MIN ? a[j * nPar + j] : 1.) * step[j] + g[j]);
+    }
+    model( pNew, fNew.data(), user );
+    result.evaluations++;
+    double ssNew = objective( ctl.poisson, nData, y, fNew.data() );
+
+    if ( std::isfinite( ssNew ) && ssNew < ss ) {
+      double rho = predicted > 0. ? (ss - ssNew) / predicted : 1.;
+      double decrease = ss - ssNew;
+      for ( int j = 0; j < nPar; ++j ) {
+        par[j] = pNew[j];
+      }
+      f.swap( fNew );
+      ss = ssNew;
+      double c = 2. * rho - 1.;
+      mu *= fmax( 1. / 3., 1. - c * c * c );
+      nu  = 2.;
+      newJacobian = true;
+      if ( decrease <= ctl.ftol * ss ||
+           sqrt( stepNorm ) <= ctl.xtol * (sqrt( parNorm ) + ctl.xtol) ) {
+        break;
+      }
+    }
+    else {
+      mu *= nu;
+      nu *= 2.;
+      if ( sqrt( stepNorm ) <= ctl.xtol * (sqrt( parNorm ) + ctl.xtol) || mu > 1e30 ) {
+        break;
+      }
+    }
+  }
+  result.residual = ctl.poisson ? ss : sqrt( ss );
+
+  /* Standard errors from the diagonal of the covariance matrix at the
+   * solution: s^2 (J^T J)^-1 for least squares, the inverse Fisher
+   * information (J^T W J)^-1 for the Poisson deviance
+   */
+  if ( ctl.errors && nData > nPar ) {
+    if ( newJacobian ) {
+      calcJacobian( nPar, par, nData, f.data(), model, jacobian, user, jac.data(), result );
+      normalEquations( ctl.poisson, nPar, nData, jac.data(), y, f.data(), w.data(), a, g );
+    }
+    double s2 = ctl.poisson ? 1. : ss / (nData - nPar);
+    for ( int k = 0; k < nPar; ++k ) {
+      double e[LM_MAX_PAR] = { 0. }, x[LM_MAX_PAR];
+      e[k] = 1.;
+      result.errors[k] = solveDamped( nPar, a, e, 0., x ) && x[k] > 0. ? sqrt( s2 * x[k] ) : 0.;
+    }
+  }
+}
@@ -0,0 +1,80 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdclm.h
+ *
+ *  Purpose:        Levenberg-Marquardt least squares solver (internal)
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCLM_H
+#define __TDCLM_H
+
+#define LM_MAX_PAR  8      /**< Maximum number of fit parameters */
+
+/** Model callback
+ *
+ *  Evaluates the model at all data points.
+ *  @param par   Parameter values
+ *  @param out   Output: nData model values
+ *  @param user  User data as passed to lmFit
+ */
+typedef void (*LmModel)( const double * par, double * out, void * user );
+
+/** Jacobian callback
+ *
+ *  Evaluates the partial derivatives of the model at all data points.
+ *  @param par   Parameter values
+ *  @param jac   Output: nPar x nData values, derivative by parameter k
+ *               at jac + k * nData
+ *  @param user  User data as passed to lmFit
+ */
+typedef void (*LmJacobian)( const double * par, double * jac, void * user );
+
+/** Control parameters of the solver */
+struct LmControl {
+  double ftol    = 1e-10;  /**< Relative decrease of the squared residual norm */
+  double xtol    = 1e-10;  /**< Relative change of the parameters */
+  int    maxIter = 200;    /**< Maximum number of iterations */
+  bool   errors  = false;  /**< Calculate standard errors of the parameters */
+  bool   poisson = false;  /**< Minimize the Poisson deviance (maximum likelihood
+                                for counts) instead of the sum of squares */
+};
+
+/** Result of the solver */
+struct LmResult {
+  int    iterations  = 0;  /**< Number of iterations, -1 on failure */
+  int    evaluations = 0;  /**< Number of model and Jacobian evaluations */
+  double residual    = 0.; /**< Euclidean norm of the residual vector;
+                                 Poisson deviance for poisson fits */
+  double errors[LM_MAX_PAR] = { 0. };  /**< Standard errors if requested, 0 if undetermined */
+};
+
+/** Least squares fit
+ *
+ *  Minimizes sum( (y[i] - model(par)[i])^2 ) over par or, with
+ *  LmControl::poisson, the Poisson deviance of the counts y.
+ *  @param nPar    Number of parameters, 1 ... LM_MAX_PAR
+ *  @param par     Input: start values; Output: fitted values
+ *  @param nData   Number of data points
+ *  @param y       Data values
+ *  @param model   Model callback
+ *  @param jacobian Jacobian callback; if NULL, the Jacobian is
+ *                 approximated by forward differences.
+ *  @param user    User data for the callbacks
+ *  @param ctl     Control parameters
+ *  @param result  Output: Fit statistics
+ */
+void lmFit( int              nPar,
+            double         * par,
+            int              nData,
+            const double   * y,
+            LmModel          model,
+            LmJacobian       jacobian,
+            void           * user,
+            const LmControl & ctl,
+            LmResult       & result );
+
+#endif
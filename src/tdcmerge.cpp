@@ -0,0 +1,323 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcmerge.cpp
+ *
+ *  Purpose:        Merged event stream of synchronized devices
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdcmerge.h"
+#include <mutex>
+#include <deque>
+#include <limits>
+
+/* Every device buffer is sorted by time already, so the merge takes the
+ * smallest head of at most TDC_MERGE_DEVICES buffers per event; a linear
+ * scan is cheaper than a heap for that few. "newest" of a device is the
+ * time of the last event it delivered, including discarded ones. A
+ * device that hasn't delivered anything holds the watermark back until
+ * it lags behind by more than maxLag, counted from the first event of
+ * any device.
+ */
+
+#define CHANNELS   32
+#define MARKERS    16
+
+static const Int64 minTime = std::numeric_limits<Int64>::min();
+static const Int64 maxTime = std::numeric_limits<Int64>::max();
+
+namespace {
+
+struct Event {
+  Int64 time;
+  Int32 channel;
+};
+
+struct DeviceBuffer {
+  std::deque<Event> events;
+  Int64             newest = minTime;
+  Int32             offset = 0;
+};
+
+struct Merge {
+  std::mutex   lock;
+  bool         enabled    = false;
+  Int32        devices    = 2;
+  Int32        bufferSize = 1024 * 1024;
+  Int64        maxLag     = 1000000000;
+  DeviceBuffer dev[TDC_MERGE_DEVICES];
+  bool         started    = false;
+  Int64        first      = minTime;     /* First event of any device */
+  Int64        emitted    = minTime;     /* Time of the last merged event */
+  Int64        lost       = 0;
+  Int64        late       = 0;
+};
+
+Merge mg;
+
+}
+
+
+static void clearData()
+{
+  for ( auto & d : mg.dev ) {
+    d.events.clear();
+    d.newest = minTime;
+  }
+  mg.started = false;
+  mg.first   = minTime;
+  mg.emitted = minTime;
+  mg.lost    = 0;
+  mg.late    = 0;
+}
+
+
+static void releaseData()
+{
+  clearData();
+  for ( auto & d : mg.dev ) {
+    std::deque<Event>().swap( d.events );
+  }
+}
+
+
+static Int64 calcWatermark()
+{
+  if ( !mg.started ) {
+    return minTime;
+  }
+  Int64 newest = minTime;
+  for ( Int32 i = 0; i < mg.devices; ++i ) {
+    if ( mg.dev[i].newest > newest ) {
+      newest = mg.dev[i].newest;
+    }
+  }
+  Int64 wm = newest;
+  for ( Int32 i = 0; i < mg.devices; ++i ) {
+    Int64 t = mg.dev[i].newest;
+    if ( t == minTime ) {
+      if ( !mg.maxLag || newest - mg.first <= mg.maxLag ) {
+        return minTime;               /* Wait for the first events */
+      }
+    }
+    else if ( t < wm && (!mg.maxLag || newest - t <= mg.maxLag) ) {
+      wm = t;
+    }
+  }
+  return wm;
+}
+
+
+int TDC_CC TDC_enableDeviceMerge( Bln32 enable )
+{
+  std::lock_guard<std::mutex> guard( mg.lock );
+  mg.enabled = enable != 0;
+  if ( mg.enabled ) {
+    clearData();
+  }
+  else {
+    releaseData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setDeviceMergeParams( Int32 devices,
+                                     Int32 bufferSize,
+                                     Int64 maxLag )
+{
+  if ( devices < 1 || devices > TDC_MERGE_DEVICES ||
+       bufferSize < 1024 || bufferSize > 64 * 1024 * 1024 ||
+       maxLag < 0 || maxLag > 1000000000000000LL ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( mg.lock );
+  mg.devices    = devices;
+  mg.bufferSize = bufferSize;
+  mg.maxLag     = maxLag;
+  if ( mg.enabled ) {
+    clearData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getDeviceMergeParams( Int32 * devices,
+                                     Int32 * bufferSize,
+                                     Int64 * maxLag )
+{
+  std::lock_guard<std::mutex> guard( mg.lock );
+  if ( devices ) {
+    *devices = mg.devices;
+  }
+  if ( bufferSize ) {
+    *bufferSize = mg.bufferSize;
+  }
+  if ( maxLag ) {
+    *maxLag = mg.maxLag;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setDeviceMergeOffset( Int32 device,
+                                     Int32 offset )
+{
+  if ( offset < -1000000000 || offset > 1000000000 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( mg.lock );
+  if ( device < 0 || device >= mg.devices ) {
+    return TDC_OutOfRange;
+  }
+  mg.dev[device].offset = offset;
+  if ( mg.enabled ) {
+    clearData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getDeviceMergeOffset( Int32   device,
+                                     Int32 * offset )
+{
+  std::lock_guard<std::mutex> guard( mg.lock );
+  if ( device < 0 || device >= mg.devices ) {
+    return TDC_OutOfRange;
+  }
+  if ( offset ) {
+    *offset = mg.dev[device].offset;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_resetDeviceMerge( void )
+{
+  std::lock_guard<std::mutex> guard( mg.lock );
+  if ( !mg.enabled ) {
+    return TDC_NotEnabled;
+  }
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addDeviceMergeTimestamps( Int32         device,
+                                         const Int64 * timestamps,
+                                         const Uint8 * channels,
+                                         Int32         count )
+{
+  if ( count < 0 || (count && (!timestamps || !channels)) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( mg.lock );
+  if ( !mg.enabled ) {
+    return TDC_NotEnabled;
+  }
+  if ( device < 0 || device >= mg.devices ) {
+    return TDC_OutOfRange;
+  }
+  DeviceBuffer & d = mg.dev[device];
+  for ( Int32 i = 0; i < count; ++i ) {
+    Int32 ch = channels[i];
+    if ( ch < CHANNELS ) {
+      ch += device * CHANNELS;
+    }
+    else if ( ch >= 100 && ch < 100 + MARKERS ) {
+      ch = TDC_MERGE_MARKER + device * MARKERS + ch - 100;
+    }
+    else {
+      continue;
+    }
+    Int64 t = timestamps[i] + d.offset;
+    if ( !mg.started ) {
+      mg.first   = t;
+      mg.started = true;
+    }
+    if ( t > d.newest ) {
+      d.newest = t;
+    }
+    if ( t < mg.emitted ) {
+      mg.late++;
+    }
+    else if ( (Int32) d.events.size() >= mg.bufferSize ) {
+      mg.lost++;
+    }
+    else {
+      d.events.push_back( { t, ch } );
+    }
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getDeviceMergeTimestamps( Int64 * timestamps,
+                                         Int32 * channels,
+                                         Int32 * count,
+                                         Bln32   flush )
+{
+  if ( !count || *count < 0 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( mg.lock );
+  if ( !mg.enabled ) {
+    return TDC_NotEnabled;
+  }
+  const Int64 wm = flush ? maxTime : calcWatermark();
+  Int32 n = 0;
+  while ( n < *count ) {
+    DeviceBuffer * next = 0;
+    for ( Int32 i = 0; i < mg.devices; ++i ) {
+      DeviceBuffer & d = mg.dev[i];
+      if ( !d.events.empty() && d.events.front().time <= wm &&
+           (!next || d.events.front().time < next ->events.front().time) ) {
+        next = &d;
+      }
+    }
+    if ( !next ) {
+      break;
+    }
+    const Event & e = next ->events.front();
+    if ( timestamps ) {
+      timestamps[n] = e.time;
+    }
+    if ( channels ) {
+      channels[n] = e.channel;
+    }
+    mg.emitted = e.time;
+    next ->events.pop_front();
+    n++;
+  }
+  *count = n;
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getDeviceMergeInfo( Int64 * watermark,
+                                   Int32 * buffered,
+                                   Int64 * lost,
+                                   Int64 * late )
+{
+  std::lock_guard<std::mutex> guard( mg.lock );
+  if ( watermark ) {
+    *watermark = calcWatermark();
+  }
+  if ( buffered ) {
+    size_t sum = 0;
+    for ( Int32 i = 0; i < mg.devices; ++i ) {
+      sum += mg.dev[i].events.size();
+    }
+    *buffered = (Int32) sum;
+  }
+  if ( lost ) {
+    *lost = mg.lost;
+  }
+  if ( late ) {
+    *late = mg.late;
+  }
+  return TDC_Ok;
+}
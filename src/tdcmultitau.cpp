@@ -0,0 +1,383 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcmultitau.cpp
+ *
+ *  Purpose:        Multi-tau correlation with logarithmic lag axis
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdcmultitau.h"
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <limits>
+
+/* Every stage keeps a ring of the last binsPerStage bins per input channel.
+ * An event at bin b of stage s is correlated with the bins b-k of the other
+ * channel's ring; afterwards it is added to its own ring. Stage s bins are
+ * 2^s times wider than stage 0 bins, so the bin index of stage s is simply
+ * the stage 0 bin index shifted right by s.
+ */
+
+#define NO_BIN  (-1)       /* Head of an empty ring */
+
+namespace {
+
+struct MultiTau {
+  std::mutex lock;
+  bool  enabled      = false;
+  Int32 binWidth     = 1000;
+  Int32 binsPerStage = 16;
+  Int32 stageCount   = 24;
+  Int32 channel1     = 1;
+  Int32 channel2     = 2;
+  std::vector<Int64>  ring[2];  /* Bin counters, stageCount x binsPerStage */
+  std::vector<Int64>  head[2];  /* Newest bin index per stage */
+  std::vector<double> corr[2];  /* 0: ch1 before ch2, 1: ch2 before ch1 */
+  Int64 count[2]     = { 0, 0 };
+  Int64 first        = 0;
+  Int64 last         = 0;
+};
+
+MultiTau mt;
+
+}
+
+
+/* Number of points of one correlation direction incl. lag 0 */
+static Int32 pointsPerDirection()
+{
+  return mt.binsPerStage + (mt.stageCount - 1) * mt.binsPerStage / 2;
+}
+
+
+static void clearData()
+{
+  size_t size = (size_t) mt.stageCount * mt.binsPerStage;
+  for ( int r = 0; r < 2; ++r ) {
+    mt.ring[r].assign( size, 0 );
+    mt.head[r].assign( mt.stageCount, NO_BIN );
+    mt.corr[r].assign( size, 0. );
+    mt.count[r] = 0;
+  }
+  mt.first = mt.last = 0;
+}
+
+
+static void releaseData()
+{
+  for ( int r = 0; r < 2; ++r ) {
+    std::vector<Int64>().swap( mt.ring[r] );
+    std::vector<Int64>().swap( mt.head[r] );
+    std::vector<double>().swap( mt.corr[r] );
+    mt.count[r] = 0;
+  }
+}
+
+
+/* Accumulate the products of an event in bin b with the ring of channel role r */
+static void correlate( int r, Int32 stage, Int64 bin, double * acc )
+{
+  const Int32   bps  = mt.binsPerStage;
+  const Int64   head = mt.head[r][stage];
+  const Int64 * ring = mt.ring[r].data() + (size_t) stage * bps;
+  Int32 k = stage ? bps / 2 : 0;
+
+  if ( head == NO_BIN ) {
+    return;
+  }
+  if ( bin - head > k ) {
+    k = (Int32) std::min<Int64>( bin - head, bps );
+  }
+  for ( ; k < bps; ++k ) {
+    Int64 b = bin - k;
+    if ( b <= head - bps ) {
+      break;
+    }
+    acc[k] += (double) ring[b % bps];
+  }
+}
+
+
+/* Count an event of channel role r in bin b of a stage */
+static void insert( int r, Int32 stage, Int64 bin )
+{
+  const Int32 bps  = mt.binsPerStage;
+  Int64 &     head = mt.head[r][stage];
+  Int64 *     ring = mt.ring[r].data() + (size_t) stage * bps;
+
+  if ( head == NO_BIN || bin - head >= bps ) {
+    std::fill( ring, ring + bps, 0 );
+    head = bin;
+  }
+  else if ( bin > head ) {
+    for ( Int64 b = head + 1; b <= bin; ++b ) {
+      ring[b % bps] = 0;
+    }
+    head = bin;
+  }
+  else if ( head - bin >= bps ) {
+    return;                                  /* Too late, bin already dropped */
+  }
+  ring[bin % bps]++;
+}
+
+
+static void processEvent( int role, bool autoCorr, Int64 time )
+{
+  const Int32 bps  = mt.binsPerStage;
+  const Int64 bin0 = time / mt.binWidth;
+
+  if ( mt.count[0] + mt.count[1] == 0 ) {
+    mt.first = time;
+  }
+  mt.last = std::max( mt.last, time );
+  mt.count[role]++;
+
+  for ( Int32 s = 0; s < mt.stageCount; ++s ) {
+    Int64 bin = bin0 >> s;
+    if ( autoCorr ) {
+      correlate( 0, s, bin, mt.corr[0].data() + (size_t) s * bps );
+      insert( 0, s, bin );
+    }
+    else {
+      /* Event on channel 2 sees earlier channel 1 events: positive lag */
+      correlate( 1 - role, s, bin, mt.corr[role == 1 ? 0 : 1].data() + (size_t) s * bps );
+      insert( role, s, bin );
+    }
+  }
+}
+
+
+int TDC_CC TDC_enableMultiTau( Bln32 enable )
+{
+  std::lock_guard<std::mutex> guard( mt.lock );
+  mt.enabled = enable != 0;
+  if ( mt.enabled ) {
+    clearData();
+  }
+  else {
+    releaseData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setMultiTauParams( Int32 binWidth,
+                                  Int32 binsPerStage,
+                                  Int32 stageCount )
+{
+  if ( binWidth < 1 || binWidth > 1000000 ||
+       binsPerStage < 4 || binsPerStage > 256 || binsPerStage % 2 ||
+       stageCount < 1 || stageCount > 40 ) {
+    return TDC_OutOfRange;
+  }
+  /* The lags of the last stage must fit into Int64 */
+  if ( (Int64) binWidth * binsPerStage >
+       (std::numeric_limits<Int64>::max() >> (stageCount - 1)) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( mt.lock );
+  mt.binWidth     = binWidth;
+  mt.binsPerStage = binsPerStage;
+  mt.stageCount   = stageCount;
+  if ( mt.enabled ) {
+    clearData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getMultiTauParams( Int32 * binWidth,
+                                  Int32 * binsPerStage,
+                                  Int32 * stageCount )
+{
+  std::lock_guard<std::mutex> guard( mt.lock );
+  if ( binWidth ) {
+    *binWidth = mt.binWidth;
+  }
+  if ( binsPerStage ) {
+    *binsPerStage = mt.binsPerStage;
+  }
+  if ( stageCount ) {
+    *stageCount = mt.stageCount;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setMultiTauInput( Int32 channel1,
+                                 Int32 channel2 )
+{
+  if ( channel1 < 1 || channel1 > 32 || channel2 < 1 || channel2 > 32 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( mt.lock );
+  mt.channel1 = channel1;
+  mt.channel2 = channel2;
+  if ( mt.enabled ) {
+    clearData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getMultiTauInput( Int32 * channel1,
+                                 Int32 * channel2 )
+{
+  std::lock_guard<std::mutex> guard( mt.lock );
+  if ( channel1 ) {
+    *channel1 = mt.channel1;
+  }
+  if ( channel2 ) {
+    *channel2 = mt.channel2;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_resetMultiTau( void )
+{
+  std::lock_guard<std::mutex> guard( mt.lock );
+  if ( !mt.enabled ) {
+    return TDC_NotEnabled;
+  }
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addMultiTauTimestamps( const Int64 * timestamps,
+                                      const Uint8 * channels,
+                                      Int32         count )
+{
+  if ( count < 0 || (count && (!timestamps || !channels)) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( mt.lock );
+  if ( !mt.enabled ) {
+    return TDC_NotEnabled;
+  }
+
+  const Int32 raw1 = mt.channel1 - 1, raw2 = mt.channel2 - 1;
+  const bool  autoCorr = raw1 == raw2;
+  for ( Int32 i = 0; i < count; ++i ) {
+    if ( timestamps[i] < 0 ) {
+      continue;
+    }
+    if ( channels[i] == raw1 ) {
+      processEvent( 0, autoCorr, timestamps[i] );
+    }
+    else if ( channels[i] == raw2 ) {
+      processEvent( 1, autoCorr, timestamps[i] );
+    }
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getMultiTauEventCount( Int64 * count1,
+                                      Int64 * count2,
+                                      Int64 * intTime )
+{
+  std::lock_guard<std::mutex> guard( mt.lock );
+  if ( !mt.enabled ) {
+    return TDC_NotEnabled;
+  }
+  bool autoCorr = mt.channel1 == mt.channel2;
+  if ( count1 ) {
+    *count1 = mt.count[0];
+  }
+  if ( count2 ) {
+    *count2 = autoCorr ? mt.count[0] : mt.count[1];
+  }
+  if ( intTime ) {
+    *intTime = mt.last - mt.first;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_calcMultiTauG2( TDC_MultiTauFunction * fct )
+{
+  if ( !fct ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( mt.lock );
+  if ( !mt.enabled ) {
+    return TDC_NotEnabled;
+  }
+
+  const Int32 bps = mt.binsPerStage;
+  const Int32 n   = pointsPerDirection();
+  const bool  autoCorr = mt.channel1 == mt.channel2;
+  if ( fct ->capacity < 2 * n - 1 ) {
+    return TDC_OutOfRange;
+  }
+
+  /* Uncorrelated events yield N1 * N2 * binWidth / T pairs per bin */
+  double n1 = (double) mt.count[0];
+  double n2 = (double) (autoCorr ? mt.count[0] : mt.count[1]);
+  double intTime = (double) (mt.last - mt.first);
+  double norm = n1 * n2 > 0. && intTime > 0. ? intTime / (n1 * n2) : 0.;
+
+  fct ->size        = 2 * n - 1;
+  fct ->indexOffset = n - 1;
+  Int32 j = 0;
+  for ( Int32 s = 0; s < mt.stageCount; ++s ) {
+    Int64 width = (Int64) mt.binWidth << s;
+    for ( Int32 k = s ? bps / 2 : 0; k < bps; ++k, ++j ) {
+      size_t idx = (size_t) s * bps + k;
+      double fwd = mt.corr[0][idx];
+      double bwd = autoCorr ? fwd : mt.corr[1][idx];
+      double val = norm / width;
+      if ( j == 0 ) {
+        /* Lag 0 bin: every direction sees only half of the bin */
+        fwd = bwd = autoCorr ? 2. * fwd : fwd + bwd;
+      }
+      fct ->lags  [n - 1 + j] =  k * width;
+      fct ->lags  [n - 1 - j] = -k * width;
+      fct ->values[n - 1 + j] = fwd * val;
+      fct ->values[n - 1 - j] = bwd * val;
+    }
+  }
+  return TDC_Ok;
+}
+
+
+TDC_MultiTauFunction * TDC_CC TDC_createMultiTauFunction( void )
+{
+  Int32 n;
+  {
+    std::lock_guard<std::mutex> guard( mt.lock );
+    n = 2 * pointsPerDirection() - 1;
+  }
+  TDC_MultiTauFunction * fct = new (std::nothrow) TDC_MultiTauFunction;
+  if ( !fct ) {
+    return nullptr;
+  }
+  fct ->lags   = new (std::nothrow) Int64[n];
+  fct ->values = new (std::nothrow) double[n];
+  if ( !fct ->lags || !fct ->values ) {
+    TDC_releaseMultiTauFunction( fct );
+    return nullptr;
+  }
+  fct ->capacity    = n;
+  fct ->size        = 0;
+  fct ->indexOffset = 0;
+  return fct;
+}
+
+
+void TDC_CC TDC_releaseMultiTauFunction( TDC_MultiTauFunction * fct )
+{
+  if ( fct ) {
+    delete[] fct ->lags;
+    delete[] fct ->values;
+    delete fct;
+  }
+}
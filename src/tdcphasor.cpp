@@ -0,0 +1,400 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcphasor.cpp
+ *
+ *  Purpose:        Phasor lifetime analysis of start-stop delays
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#include "tdcphasor.h"
+#include "tdcsync.h"
+#include <mutex>
+#include <vector>
+#include <cmath>
+
+/* The table entry of delay bin b holds cos and sin of the phase at the
+ * bin center. The calibration is a complex factor applied to the sums
+ * on retrieval, so the accumulation itself never changes.
+ * With a sync divider, the delays are taken from the sync model and
+ * scaled from the estimated to the nominal period to index the table.
+ */
+
+#define CHANNELS    32
+#define MAX_BINS    (4 * 1024 * 1024)
+#define MAX_DIVIDER 1024
+
+static const double twoPi = 6.283185307179586;
+
+namespace {
+
+struct Trig {
+  float cos, sin;
+};
+
+struct Phasor {
+  std::mutex  lock;
+  bool        enabled   = false;
+  Int32       period    = 12500;
+  Int32       binWidth  = 1;
+  Int32       harmonic  = 1;
+  Int32       startChan = 1;
+  unsigned    stopMask  = 0;          /* Bitmask of stop channels */
+  std::vector<Trig> table;
+  double      sumCos[CHANNELS];
+  double      sumSin[CHANNELS];
+  Int64       count[CHANNELS];
+  Int64       lastStart = 0;
+  bool        started   = false;      /* A start event has been seen */
+  SyncModel   sync;                   /* Used if divider > 1 */
+  double      corrRe    = 1.;         /* Calibration factor */
+  double      corrIm    = 0.;
+};
+
+Phasor ph;
+
+}
+
+
+static void clearChannel( int ch )
+{
+  ph.sumCos[ch] = ph.sumSin[ch] = 0.;
+  ph.count[ch]  = 0;
+}
+
+
+static void clearData()
+{
+  for ( int i = 0; i < CHANNELS; ++i ) {
+    clearChannel( i );
+  }
+  ph.started = false;
+  ph.sync.reset();
+}
+
+
+static void buildTable()
+{
+  Int32 bins = (ph.period + ph.binWidth - 1) / ph.binWidth;
+  ph.table.resize( bins );
+  for ( Int32 b = 0; b < bins; ++b ) {
+    double center = ((double) b + .5) * ph.binWidth;
+    if ( center > ph.period ) {
+      center = .5 * ((double) b * ph.binWidth + ph.period);
+    }
+    double phase = twoPi * ph.harmonic * center / ph.period;
+    ph.table[b].cos = (float) cos( phase );
+    ph.table[b].sin = (float) sin( phase );
+  }
+}
+
+
+static void processEvents( const Int64 * timestamps, const Uint8 * channels, Int32 count )
+{
+  const Int64  period   = ph.period;
+  const Int32  binWidth = ph.binWidth;
+  const int    start    = ph.startChan - 1;
+  const Trig * table    = ph.table.data();
+  const bool   divided  = ph.sync.divider() > 1;
+
+  for ( Int32 i = 0; i < count; ++i ) {
+    int ch = channels[i];
+    if ( ch == start ) {
+      if ( divided ) {
+        ph.sync.start( timestamps[i] );
+        continue;
+      }
+      ph.lastStart = timestamps[i];
+      ph.started   = true;
+      continue;
+    }
+    if ( ch >= CHANNELS || !(ph.stopMask & (1u << ch)) ) {
+      continue;
+    }
+    Int64 delay;
+    if ( start < 0 ) {
+      delay = timestamps[i] % period;
+      if ( delay < 0 ) {
+        delay += period;
+      }
+    }
+    else if ( divided ) {
+      if ( !ph.sync.locked() ) {
+        continue;
+      }
+      delay = (Int64) (ph.sync.delay( timestamps[i] ) * period / ph.sync.period());
+      if ( delay >= period ) {
+        delay = period - 1;
+      }
+    }
+    else if ( ph.started ) {
+      delay = timestamps[i] - ph.lastStart;
+      if ( delay < 0 ) {
+        continue;
+      }
+      if ( delay >= period ) {
+        delay %= period;
+      }
+    }
+    else {
+      continue;
+    }
+    const Trig & t = table[delay / binWidth];
+    ph.sumCos[ch] += t.cos;
+    ph.sumSin[ch] += t.sin;
+    ph.count[ch]++;
+  }
+}
+
+
+/* Calibrated phasor of a channel; false if there are no events */
+static bool phasor( int ch, double & g, double & s )
+{
+  if ( !ph.count[ch] ) {
+    g = s = 0.;
+    return false;
+  }
+  double gRaw = ph.sumCos[ch] / ph.count[ch];
+  double sRaw = ph.sumSin[ch] / ph.count[ch];
+  g = ph.corrRe * gRaw - ph.corrIm * sRaw;
+  s = ph.corrIm * gRaw + ph.corrRe * sRaw;
+  return true;
+}
+
+
+int TDC_CC TDC_enablePhasor( Bln32 enable )
+{
+  std::lock_guard<std::mutex> guard( ph.lock );
+  ph.enabled = enable != 0;
+  if ( ph.enabled ) {
+    buildTable();
+    clearData();
+  }
+  else {
+    std::vector<Trig>().swap( ph.table );
+    clearData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setPhasorParams( Int32 period,
+                                Int32 binWidth,
+                                Int32 harmonic )
+{
+  if ( period < 1 || period > 1000000000 || binWidth < 1 || binWidth > period ||
+       (period + binWidth - 1) / binWidth > MAX_BINS || harmonic < 1 || harmonic > 16 ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( ph.lock );
+  ph.period   = period;
+  ph.binWidth = binWidth;
+  ph.harmonic = harmonic;
+  ph.corrRe   = 1.;
+  ph.corrIm   = 0.;
+  if ( ph.enabled ) {
+    buildTable();
+    clearData();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getPhasorParams( Int32 * period,
+                                Int32 * binWidth,
+                                Int32 * harmonic )
+{
+  std::lock_guard<std::mutex> guard( ph.lock );
+  if ( period ) {
+    *period = ph.period;
+  }
+  if ( binWidth ) {
+    *binWidth = ph.binWidth;
+  }
+  if ( harmonic ) {
+    *harmonic = ph.harmonic;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setPhasorStartInput( Int32 startChan )
+{
+  if ( startChan < 0 || startChan > CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( ph.lock );
+  ph.startChan = startChan;
+  ph.corrRe    = 1.;
+  ph.corrIm    = 0.;
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getPhasorStartInput( Int32 * startChan )
+{
+  std::lock_guard<std::mutex> guard( ph.lock );
+  if ( startChan ) {
+    *startChan = ph.startChan;
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_setPhasorSyncDivider( Int32 divider )
+{
+  if ( divider < 1 || divider > MAX_DIVIDER ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( ph.lock );
+  ph.sync.setDivider( divider );
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getPhasorSyncDivider( Int32  * divider,
+                                     double * period )
+{
+  std::lock_guard<std::mutex> guard( ph.lock );
+  if ( divider ) {
+    *divider = ph.sync.divider();
+  }
+  if ( period ) {
+    *period = ph.sync.period();
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addPhasorChannel( Int32 stopCh,
+                                 Bln32 add )
+{
+  if ( stopCh < 1 || stopCh > CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( ph.lock );
+  unsigned bit = 1u << (stopCh - 1);
+  if ( !add == !(ph.stopMask & bit) ) {
+    return TDC_Ok;
+  }
+  ph.stopMask ^= bit;
+  clearChannel( stopCh - 1 );
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_calibratePhasor( Int32  channel,
+                                double refLifetime )
+{
+  if ( refLifetime < 0. || (refLifetime > 0. && (channel < 1 || channel > CHANNELS)) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( ph.lock );
+  if ( refLifetime == 0. ) {
+    ph.corrRe = 1.;
+    ph.corrIm = 0.;
+    return TDC_Ok;
+  }
+  if ( !ph.count[channel - 1] ) {
+    return TDC_NotAvailable;
+  }
+  double gRaw = ph.sumCos[channel - 1] / ph.count[channel - 1];
+  double sRaw = ph.sumSin[channel - 1] / ph.count[channel - 1];
+  double mRaw = sqrt( gRaw * gRaw + sRaw * sRaw );
+  if ( !(mRaw > 0.) ) {
+    return TDC_NotAvailable;
+  }
+  /* Reference point on the universal circle */
+  double wt   = twoPi * ph.harmonic / ph.period * refLifetime;
+  double gRef = 1. / (1. + wt * wt);
+  double sRef = wt * gRef;
+  /* corr = ref / raw as complex numbers */
+  ph.corrRe = (gRef * gRaw + sRef * sRaw) / (mRaw * mRaw);
+  ph.corrIm = (sRef * gRaw - gRef * sRaw) / (mRaw * mRaw);
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_resetPhasor( void )
+{
+  std::lock_guard<std::mutex> guard( ph.lock );
+  if ( !ph.enabled ) {
+    return TDC_NotEnabled;
+  }
+  clearData();
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_addPhasorTimestamps( const Int64 * timestamps,
+                                    const Uint8 * channels,
+                                    Int32         count )
+{
+  if ( count < 0 || (count && (!timestamps || !channels)) ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( ph.lock );
+  if ( !ph.enabled ) {
+    return TDC_NotEnabled;
+  }
+  processEvents( timestamps, channels, count );
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getPhasor( Int32    channel,
+                          double * g,
+                          double * s,
+                          Int64  * count )
+{
+  if ( channel < 1 || channel > CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( ph.lock );
+  if ( !ph.enabled || !(ph.stopMask & (1u << (channel - 1))) ) {
+    return TDC_NotEnabled;
+  }
+  double gc, sc;
+  phasor( channel - 1, gc, sc );
+  if ( g ) {
+    *g = gc;
+  }
+  if ( s ) {
+    *s = sc;
+  }
+  if ( count ) {
+    *count = ph.count[channel - 1];
+  }
+  return TDC_Ok;
+}
+
+
+int TDC_CC TDC_getPhasorLifetime( Int32    channel,
+                                  double * tauPhase,
+                                  double * tauMod )
+{
+  if ( channel < 1 || channel > CHANNELS ) {
+    return TDC_OutOfRange;
+  }
+  std::lock_guard<std::mutex> guard( ph.lock );
+  if ( !ph.enabled || !(ph.stopMask & (1u << (channel - 1))) ) {
+    return TDC_NotEnabled;
+  }
+  double g, s;
+  if ( !phasor( channel - 1, g, s ) ) {
+    return TDC_NotAvailable;
+  }
+  double w  = twoPi * ph.harmonic / ph.period;
+  double m2 = g * g + s * s;
+  if ( tauPhase ) {
+    *tauPhase = g != 0. ? s / (w * g) : 0.;
+  }
+  if ( tauMod ) {
+    *tauMod = m2 > 0. && m2 < 1. ? sqrt( 1. / m2 - 1. ) / w : 0.;
+  }
+  return TDC_Ok;
+}
@@ -0,0 +1,112 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcpool.h
+ *
+ *  Purpose:        Pool of persistent worker threads (internal)
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCPOOL_H
+#define __TDCPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Pool of worker threads
+ *
+ *  run() executes a job for the indices 0 ... count-1; the indices are
+ *  handed out one by one to the workers and the calling thread. run()
+ *  returns when all indices are done. Only one run() at a time.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool( int threads )
+  {
+    for ( int i = 1; i < threads; ++i ) {
+      _workers.emplace_back( [this] { work(); } );
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> guard( _lock );
+      _quit = true;
+    }
+    _wake.notify_all();
+    for ( auto & w : _workers ) {
+      w.join();
+    }
+  }
+
+  ThreadPool( const ThreadPool & ) = delete;
+  ThreadPool & operator=( const ThreadPool & ) = delete;
+
+  /** Number of threads incl. the caller of run() */
+  int threads() const { return (int) _workers.size() + 1; }
+
+  void run( int count, const std::function<void(int)> & job )
+  {
+    std::unique_lock<std::mutex> guard( _lock );
+    _job   = &job;
+    _count = count;
+    _next  = 0;
+    _busy  = (int) _workers.size();
+    ++_generation;
+    guard.unlock();
+    _wake.notify_all();
+
+    drain();
+
+    guard.lock();
+    _done.wait( guard, [this] { return _busy == 0; } );
+    _job = 0;
+  }
+
+private:
+  void drain()
+  {
+    for ( int i = _next++; i < _count; i = _next++ ) {
+      (*_job)( i );
+    }
+  }
+
+  void work()
+  {
+    unsigned seen = 0;
+    for ( ;; ) {
+      {
+        std::unique_lock<std::mutex> guard( _lock );
+        _wake.wait( guard, [&] { return _quit || _generation != seen; } );
+        if ( _quit ) {
+          return;
+        }
+        seen = _generation;
+      }
+      drain();
+      std::lock_guard<std::mutex> guard( _lock );
+      if ( --_busy == 0 ) {
+        _done.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread>           _workers;
+  std::mutex                         _lock;
+  std::condition_variable            _wake, _done;
+  const std::function<void(int)>   * _job  = 0;
+  int                                _count = 0;
+  std::atomic<int>                   _next { 0 };
+  int                                _busy = 0;
+  unsigned                           _generation = 0;
+  bool                               _quit = false;
+};
+
+#endif
@@ -0,0 +1,112 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcsync.h
+ *
+ *  Purpose:        Analytic model of a divided laser sync (internal)
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCSYNC_H
+#define __TDCSYNC_H
+
+#include "tdcdecl.h"
+#include <cmath>
+
+/** Model of the laser pulse train behind a divided sync input
+ *
+ *  With a sync divider, only every divider-th laser pulse arrives as a
+ *  start event. Instead of generating the skipped pulses, the pulse
+ *  train is represented by a period and the time of one pulse (the
+ *  anchor); the delay of a stop event is its time since the anchor
+ *  modulo the period.
+ *
+ *  Both are tracked by a second order loop like a PLL: every start event
+ *  is compared with its prediction, and the anchor and the period are
+ *  corrected by fractions of the difference. Lost start events are
+ *  bridged by counting the periods since the anchor. The anchor is kept
+ *  as an integer part and a small fraction, so the precision doesn't
+ *  degrade with the size of the timestamps.
+ */
+class SyncModel {
+public:
+  SyncModel() : _divider( 1 ) { reset(); }
+
+  void setDivider( Int32 divider ) { _divider = divider; reset(); }
+
+  Int32 divider() const { return _divider; }
+
+  void reset()
+  {
+    _base   = 0;
+    _frac   = 0.;
+    _period = 0.;
+    _starts = 0;
+  }
+
+  /** Period and anchor are known */
+  bool locked() const { return _starts >= 2; }
+
+  /** Estimated period; 0 if not locked */
+  double period() const { return locked() ? _period : 0.; }
+
+  /** Process a start event */
+  void start( Int64 t )
+  {
+    if ( _starts == 0 ) {
+      setAnchor( t, 0. );
+    }
+    else if ( _starts == 1 ) {
+      Int64 dt = t - _base;
+      if ( dt <= 0 ) {
+        return;
+      }
+      _period = (double) dt / _divider;
+      setAnchor( t, 0. );
+    }
+    else {
+      double since   = (double) (t - _base) - _frac;
+      double periods = floor( since / _period + .5 );
+      if ( periods < 1. ) {
+        return;                       /* Spurious start, ignore */
+      }
+      double err = since - periods * _period;
+      _period += beta * err / periods;
+      setAnchor( _base, _frac + periods * _period + alpha * err );
+    }
+    if ( _starts < 2 ) {
+      ++_starts;
+    }
+  }
+
+  /** Delay of an event at t to the last modelled pulse, 0 <= delay < period.
+   *  The model must be locked.
+   */
+  double delay( Int64 t ) const
+  {
+    double since = (double) (t - _base) - _frac;
+    return since - floor( since / _period ) * _period;
+  }
+
+private:
+  /* Loop gains of phase and period correction, critically damped */
+  static constexpr double alpha = .25;
+  static constexpr double beta  = alpha * alpha / 4.;
+
+  void setAnchor( Int64 base, double frac )
+  {
+    Int64 whole = (Int64) floor( frac );
+    _base = base + whole;
+    _frac = frac - (double) whole;
+  }
+
+  Int32  _divider;
+  Int64  _base;                       /* Anchor, integer part */
+  double _frac;                       /* Anchor, fraction 0 <= _frac < 1 */
+  double _period;
+  int    _starts;                     /* Start events seen, up to 2 */
+};
+
+#endif
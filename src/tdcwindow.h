@@ -0,0 +1,82 @@
+/******************************************************************************
+ *
+ *  Project:        TDC Extension Library
+ *
+ *  Filename:       tdcwindow.h
+ *
+ *  Purpose:        Sliding window of recent events of a channel (internal)
+ *
+ ******************************************************************************/
+/* $Id$ */
+
+#ifndef __TDCWINDOW_H
+#define __TDCWINDOW_H
+
+#include "tdcdecl.h"
+#include <vector>
+#include <cstddef>
+
+/** Sliding window of recent timestamps
+ *
+ *  Ring buffer of timestamps in increasing order. New events are
+ *  appended at the newest end; events that are too old for every
+ *  consumer are dropped from the oldest end. The buffer grows on demand,
+ *  its capacity is always a power of 2. Nothing is allocated before the
+ *  first event, so the windows of unused analyses cost no memory.
+ */
+class EventWindow {
+public:
+  EventWindow() : _start( 0 ), _count( 0 ) {}
+
+  void clear() { _start = _count = 0; }
+
+  Int32 size() const { return (Int32) _count; }
+
+  /** Element i, counted from the oldest (0) */
+  Int64 at( Int32 i ) const { return _buf[(_start + i) & (_buf.size() - 1)]; }
+
+  /** Element i, counted from the newest (0) */
+  Int64 back( Int32 i ) const { return at( (Int32) _count - 1 - i ); }
+
+  void push( Int64 t )
+  {
+    if ( _count == _buf.size() ) {
+      grow();
+    }
+    _buf[(_start + _count) & (_buf.size() - 1)] = t;
+    ++_count;
+  }
+
+  /** Drop the oldest event */
+  void popFront()
+  {
+    _start = (_start + 1) & (_buf.size() - 1);
+    --_count;
+  }
+
+  /** Drop all events older than t */
+  void dropBefore( Int64 t )
+  {
+    while ( _count && _buf[_start] < t ) {
+      _start = (_start + 1) & (_buf.size() - 1);
+      --_count;
+    }
+  }
+
+private:
+  void grow()
+  {
+    std::vector<Int64> buf( _buf.empty() ? 16 : 2 * _buf.size() );
+    for ( size_t i = 0; i < _count; ++i ) {
+      buf[i] = at( (Int32) i );
+    }
+    _buf.swap( buf );
+    _start = 0;
+  }
+
+  std::vector<Int64> _buf;
+  size_t _start;
+  size_t _count;
+};
+
+#endif